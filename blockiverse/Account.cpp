@@ -20,6 +20,131 @@
 
 namespace bv {
 
+    void Account::writeLogout(SQLiteDB &db,s64 user) {
+        db.perform(bvquery::logoutAccount,user);
+    }
 
+    void Account::writeMove(SQLiteDB &db,s64 entity,s64 cx,s64 cy,s64 cz) {
+        db.perform(bvquery::moveEntity,entity,cx,cy,cz);
+    }
+
+    void Account::tick() {
+        if (editsDropped>0) {
+            BVLOG_WARN("Account [" << this << "] refused " << editsDropped << " node edit(s) last tick");
+            editsDropped=0;
+        }
+        editsLeft=root.streaming.edits;
+        if (moved) {
+            moved=false;
+            // only the latest move of a player is written
+            persist(rowKey("place",playerId),boost::bind(&Account::writeMove,_1,playerId,
+                moveTarget.x,moveTarget.y,moveTarget.z));
+            stream.moveTo(moveTarget);
+        }
+        stream.tick();
+    }
+
+    void Account::dmc_MoveTo(value_queue &vqueue) {
+        /*  in: int: chunk x within the player's pivot entity
+        **      int: chunk y
+        **      int: chunk z
+        **
+        ** out: nothing
+        **
+        ** Chunk streaming follows the player from the next tick,
+        ** to the last of the moves made since.  A move further
+        ** than the view distance (stream_dist) from where the
+        ** player was at the last tick is refused.
+        */
+        s64 cz=ctx.getarg<s64>(); /* LIFO is z */
+        s64 cy=ctx.getarg<s64>();
+        s64 cx=ctx.getarg<s64>();
+        bvmap::ChunkPos to(pivotId,cx,cy,cz);
+        if (!stream.reaches(to)) {
+            BVLOG_WARN("Account [" << this << "] MoveTo " << cx << ',' << cy << ',' << cz
+                       << " refused: beyond the view distance");
+            return;
+        }
+        moveTarget=to;
+        moved=true;
+    }
+
+    void Account::dmc_SetNode(value_queue &vqueue) {
+        /*  in: int: chunk x within the player's pivot entity
+        **      int: chunk y
+        **      int: chunk z
+        **      int: cell index within the chunk
+        **      blob: new node (see bvmap::putNode)
+        **
+        ** out: nothing
+        **
+        ** Applied with all other edits at the next tick and
+        ** passed on to clients holding the chunk as a delta.
+        ** Edits beyond the per tick limit (stream_edits) and
+        ** edits to chunks outside the player's interest region
+        ** are refused.
+        */
+        bvnet::blob raw=ctx.getarg<bvnet::blob>(); /* LIFO is node */
+        s64 cell=ctx.getarg<s64>();
+        s64 cz=ctx.getarg<s64>();
+        s64 cy=ctx.getarg<s64>();
+        s64 cx=ctx.getarg<s64>();
+        // checked here while still 64 bits (edit() takes 32)
+        if (cell<0 || cell>=s64(bvmap::chunk_cells))
+            throw std::out_of_range("chunk cell index");
+        const char *p=raw.data();
+        bvmap::Node n=bvmap::getNode(p,p+raw.size());
+        bvmap::ChunkPos pos(pivotId,cx,cy,cz);
+        if (!stream.covers(pos)) {
+            BVLOG_DEBUG("Account [" << this << "] SetNode outside the interest region");
+            ++editsDropped;
+            return;
+        }
+        if (editsLeft==0) {
+            ++editsDropped;
+            return;
+        }
+        --editsLeft;
+        if (root.edits!=NULL)
+            root.edits->edit(pos,cell,n);
+    }
+
+    void Account::dmc_ChunkResync(value_queue &vqueue) {
+        /*  in: int: entity the chunk belongs to
+        **      int: chunk x
+        **      int: chunk y
+        **      int: chunk z
+        **
+        ** out: nothing
+        **
+        ** Client lost track of the chunk (a delta did not match
+        ** its version) so it is sent whole again.
+        */
+        s64 cz=ctx.getarg<s64>(); /* LIFO is z */
+        s64 cy=ctx.getarg<s64>();
+        s64 cx=ctx.getarg<s64>();
+        s64 entity=ctx.getarg<s64>();
+        stream.resync(bvmap::ChunkPos(entity,cx,cy,cz));
+    }
+
+    void Account::dmc_ChunkDropped(value_queue &vqueue) {
+        /*  in: int: entity the chunk belongs to
+        **      int: chunk x
+        **      int: chunk y
+        **      int: chunk z
+        **
+        ** out: nothing
+        **
+        ** Client could not unpack the chunk and threw it away so
+        ** neither deltas nor resends are sent for it any more.
+        */
+        s64 cz=ctx.getarg<s64>(); /* LIFO is z */
+        s64 cy=ctx.getarg<s64>();
+        s64 cx=ctx.getarg<s64>();
+        s64 entity=ctx.getarg<s64>();
+        BVLOG_WARN("Account [" << this << "] client dropped chunk "
+                   << entity << ':' << cx << ',' << cy << ',' << cz);
+        stream.forget(bvmap::ChunkPos(entity,cx,cy,cz));
+    }
 
 };
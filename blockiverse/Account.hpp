@@ -24,8 +24,11 @@
 #include "database.hpp"
 #include "queries.hpp"
 #include "server.hpp"
+#include "chunkstream.hpp"
 #include "lua-5.3.0/lua_all.h"
 #include "bvgame/core.hpp"
+#include <boost/lexical_cast.hpp>
+#include <memory>
 
 using bvdb::SQLiteDB;
 using bvdb::DBIsBusy;
@@ -38,18 +41,62 @@ namespace bv {
     class Account : public bvnet::object {
     private:
         serverRoot &root;
-        SQLiteDB &db;
         s64 userId;
         s64 playerId;
-        lua_State *asUser;
+        s64 pivotId;
+        /** @brief closed with the Account (or when its ctor throws) */
+        std::unique_ptr<lua_State,void(*)(lua_State*)> asUser;
+        ChunkStreamer stream;
+        unsigned editsLeft;         /**< @brief SetNode calls accepted until the next tick */
+        unsigned editsDropped;      /**< @brief SetNode calls refused since the last tick */
+        bool moved;                 /**< @brief a MoveTo arrived since the last tick */
+        bvmap::ChunkPos moveTarget; /**< @brief latest MoveTo (applied next tick) */
+        /** @brief key of the writes of what for row id (see DBWriter::put) */
+        static string rowKey(const char *what,s64 id) {
+            return string(what)+':'+boost::lexical_cast<string>(id);
+        }
+        static void writeLogout(SQLiteDB &db,s64 user);
+        static void writeMove(SQLiteDB &db,s64 entity,s64 cx,s64 cy,s64 cz);
+        /**
+        *   @brief run op on the world writer (here and now if
+        *   there is none or it has stopped)
+        *   @param keep op must not be dropped (see DBWriter::put)
+        */
+        void persist(const string &key,const DBWriter::write_op &op,bool keep=false) {
+            if (root.writes!=NULL) {
+                try {
+                    root.writes->put(key,op,keep);
+                    return;
+                } catch (DBWriterStopped &e) {
+                    BVLOG_WARN("Account [" << this << "] " << key << ": " << e.what());
+                }
+            }
+            op(*root.connections->acquire());
+        }
+        /** @brief per streaming tick upkeep */
+        void tick();
     protected:
+        void dmc_MoveTo(value_queue &vqueue);
+        void dmc_SetNode(value_queue &vqueue);
+        void dmc_ChunkResync(value_queue &vqueue);
+        void dmc_ChunkDropped(value_queue &vqueue);
     public:
-        Account(bvnet::session &sess,serverRoot *server,s64 who) :
+        /** @param db connection the login is done on (not kept) */
+        Account(bvnet::session &sess,serverRoot *server,s64 who,SQLiteDB &db) :
             bvnet::object(sess),
             root(*server),
-            db(server->get_db()),
             userId(who),
-            asUser(luaL_newstate()) {
+            pivotId(0),
+            asUser(luaL_newstate(),lua_close),
+            stream(sess,*server->connections,server->edits,server->streaming),
+            editsLeft(server->streaming.edits),
+            editsDropped(0),
+            moved(false),
+            moveTarget(0,0,0,0) {
+            register_dmc("MoveTo"       ,(dmc)&Account::dmc_MoveTo);
+            register_dmc("SetNode"      ,(dmc)&Account::dmc_SetNode);
+            register_dmc("ChunkResync"  ,(dmc)&Account::dmc_ChunkResync);
+            register_dmc("ChunkDropped" ,(dmc)&Account::dmc_ChunkDropped);
 
             /** TODO:
             *   Some of the standard lualibs are not going to behave well
@@ -67,43 +114,48 @@ namespace bv {
             *    have multiargument output being interleaved with
             *    output from other threads.)
             */
-            luaL_openlibs(asUser);
+            luaL_openlibs(asUser.get());
+            charge(sizeof(Account)-sizeof(bvnet::object)+1024*lua_gc(asUser.get(),LUA_GCCOUNT,0));
 
             // attempts login
             // throws if multiple login attempt for same account)
-            statement doLogin=db.prepare(bvquery::loginAccount);
-            db.bind(doLogin,1,userId);
-            query_result dontcare;
-            dontcare=db.loop_run(doLogin);
+            // (a logout still on its way to the database is not one)
+            if (root.writes!=NULL)
+                root.writes->settle(rowKey("logout",userId));
+            db.perform(bvquery::loginAccount,userId);
 
             playerId=bvgame::core::getPlayer(db,userId);
 
-            LOCK_COUT
-            cout << "Account [" << this
+            // stream from wherever the player was left
+            bvquery::row::findPlace place;
+            if (db.fetch(bvquery::findPlace,place,playerId)) {
+                using namespace bvquery::result::findPlace;
+                pivotId=std::get<bvquery::result::findPlace::pivotId>(place);
+                stream.moveTo(bvmap::ChunkPos(pivotId,
+                    std::get<Cx>(place),std::get<Cy>(place),std::get<Cz>(place)));
+            }
+            ctx.every("account",stream.period(),boost::bind(&Account::tick,this));
+
+            BVLOG_INFO("Account [" << this
                  << "] ctor (userid=" << userId
                  << ", playerId=" << playerId
-                 << ")" << endl;
-            UNLOCK_COUT
+                 << ")");
 
         }
         virtual ~Account() {
-            LOCK_COUT
-            cout << "Account [" << this << "] dtor" << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("Account [" << this << "] dtor");
+
+            ctx.every("account",stream.period(),boost::function<void()>());
 
-            lua_close(asUser);
+            asUser.reset();
 
-            // logout user
+            // logout user (retried until it is written: a lost
+            // logout locks the account out until a restart)
             // gobble exceptions since this is a dtor
             try {
-                statement doLogout=db.prepare(bvquery::logoutAccount);
-                db.bind(doLogout,1,userId);
-                query_result dontcare;
-                dontcare=db.loop_run(doLogout);
-            } catch (DBError &e) {
-                LOCK_COUT
-                cout << "Account [" << this << "] dtor: " << e.what() << endl;
-                UNLOCK_COUT
+                persist(rowKey("logout",userId),boost::bind(&Account::writeLogout,_1,userId),true);
+            } catch (std::exception &e) {
+                BVLOG_WARN("Account [" << this << "] dtor: " << e.what());
             }
         }
         virtual const char *getType() {return "userAccount";}
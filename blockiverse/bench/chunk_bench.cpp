@@ -0,0 +1,86 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file bench/chunk_bench.cpp
+**
+**  Micro-benchmark of full-chunk scans over the dense Node
+**  array layout versus the planar Chunk layout.
+**
+**  usage: chunkbench [chunks] [passes]
+**
+*/
+#include "corpus.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+using namespace bvmap;
+using namespace bvbench;
+
+namespace {
+
+    typedef std::chrono::steady_clock clk;
+
+    /** @brief solid cells, the same code for either layout */
+    struct solidCount {
+        unsigned long count;
+        solidCount() : count(0) {}
+        void operator()(unsigned,uint16_t id) {count+=(id!=0);}
+    };
+
+    double ms(clk::duration d) {
+        return std::chrono::duration<double,std::milli>(d).count();
+    }
+
+}
+
+int main(int argc,char **argv) {
+    unsigned chunks=(argc>1)?atoi(argv[1]):2048;
+    unsigned passes=(argc>2)?atoi(argv[2]):20;
+
+    std::vector<Node> dense(size_t(chunks)*chunk_cells);
+    std::vector<Chunk> planar(chunks);
+    size_t planarBytes=0;
+    for (unsigned c=0;c<chunks;++c) {
+        Node *cells=&dense[size_t(c)*chunk_cells];
+        // every fourth chunk is open air/space
+        if (c%4==3) {
+            air(cells);
+        } else {
+            terrain(cells,c);
+        }
+        planar[c].pack(cells);
+        planarBytes+=planar[c].footprint();
+    }
+
+    solidCount a,b;
+    clk::time_point t0=clk::now();
+    for (unsigned p=0;p<passes;++p)
+        for (unsigned c=0;c<chunks;++c)
+            cellEach<field::blockId>(&dense[size_t(c)*chunk_cells],std::ref(a));
+    clk::time_point t1=clk::now();
+    for (unsigned p=0;p<passes;++p)
+        for (unsigned c=0;c<chunks;++c)
+            planar[c].each<field::blockId>(std::ref(b));
+    clk::time_point t2=clk::now();
+
+    double cells=double(chunks)*chunk_cells*passes;
+    printf("chunks=%u passes=%u\n",chunks,passes);
+    printf("dense  : %10.2f ms %6.2f ns/cell %10zu bytes solid=%lu\n",
+        ms(t1-t0),ms(t1-t0)*1e6/cells,dense.size()*sizeof(Node),a.count);
+    printf("planar : %10.2f ms %6.2f ns/cell %10zu bytes solid=%lu\n",
+        ms(t2-t1),ms(t2-t1)*1e6/cells,planarBytes,b.count);
+    return (a.count==b.count)?0:1;
+}
@@ -0,0 +1,113 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file bench/codec_bench.cpp
+**
+**  Compression ratio and speed of each chunk codec over
+**  generated corpora.  Speeds are in MB/s of serialized
+**  (uncompressed) chunk data either way.
+**
+**  usage: codecbench [chunks] [passes]
+**
+*/
+#include "corpus.hpp"
+#include "../chunkcodec.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace bvmap;
+using namespace bvbench;
+
+namespace {
+
+    typedef std::chrono::steady_clock clk;
+
+    double secs(clk::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    /** @brief serialized chunks of one kind */
+    struct corpus {
+        const char *name;
+        std::vector<std::string> chunks;
+        size_t bytes;
+        corpus(const char *n) : name(n),bytes(0) {}
+        void add(const Node *cells) {
+            Chunk c;
+            c.pack(cells);
+            chunks.push_back(std::string());
+            c.serialize(chunks.back());
+            bytes+=chunks.back().size();
+        }
+    };
+
+    /** @return false if a chunk did not survive the round trip */
+    bool run(const corpus &in,const ChunkCodec &codec,unsigned passes) {
+        std::vector<std::string> packed(in.chunks.size());
+        size_t packedBytes=0;
+        clk::time_point t0=clk::now();
+        for (unsigned p=0;p<passes;++p) {
+            for (size_t i=0;i<in.chunks.size();++i) {
+                packed[i].clear();
+                codec.compress(in.chunks[i].data(),in.chunks[i].size(),packed[i]);
+            }
+        }
+        clk::time_point t1=clk::now();
+        std::string out;
+        bool ok=true;
+        for (unsigned p=0;p<passes;++p) {
+            for (size_t i=0;i<in.chunks.size();++i) {
+                out.clear();
+                codec.decompress(packed[i].data(),packed[i].size(),in.chunks[i].size(),out);
+                if (p==0)
+                    ok=ok && (out==in.chunks[i]);
+            }
+        }
+        clk::time_point t2=clk::now();
+        for (size_t i=0;i<packed.size();++i)
+            packedBytes+=packed[i].size();
+        double mb=double(in.bytes)*passes/1e6;
+        printf("%-8s %-5s %10zu -> %10zu  ratio %6.2f  comp %8.1f MB/s  decomp %8.1f MB/s%s\n",
+            in.name,codec.name(),in.bytes,packedBytes,double(in.bytes)/packedBytes,
+            mb/secs(t1-t0),mb/secs(t2-t1),ok?"":"  MISMATCH");
+        return ok;
+    }
+
+}
+
+int main(int argc,char **argv) {
+    unsigned chunks=(argc>1)?atoi(argv[1]):512;
+    unsigned passes=(argc>2)?atoi(argv[2]):10;
+
+    corpus open("air"),ground("terrain"),ship("ship");
+    std::vector<Node> cells(chunk_cells);
+    for (unsigned c=0;c<chunks;++c) {
+        air(&cells[0]);
+        open.add(&cells[0]);
+        terrain(&cells[0],c);
+        ground.add(&cells[0]);
+        shipInterior(&cells[0],c);
+        ship.add(&cells[0]);
+    }
+
+    printf("chunks=%u passes=%u\n",chunks,passes);
+    bool ok=true;
+    const corpus *all[]={&open,&ground,&ship};
+    for (const corpus *in : all)
+        for (const ChunkCodec *codec : allCodecs())
+            ok=run(*in,*codec,passes) && ok;
+    return ok?0:1;
+}
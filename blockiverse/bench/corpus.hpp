@@ -0,0 +1,102 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file bench/corpus.hpp
+**
+**  Generated chunk contents shared by the benchmarks
+**
+*/
+#ifndef BV_BENCH_CORPUS_HPP_INCLUDED
+#define BV_BENCH_CORPUS_HPP_INCLUDED
+
+#include "../chunk.hpp"
+#include <cstdlib>
+
+namespace bvbench {
+
+    using namespace bvmap;
+
+    /** @brief open air or space: every cell the same */
+    inline void air(Node *cells) {
+        Node n=Node();
+        n.blkLight=15;
+        for (unsigned i=0;i<chunk_cells;++i)
+            cells[i]=n;
+    }
+
+    /** @brief layered terrain with scattered ore and a few decorations */
+    inline void terrain(Node *cells,unsigned seed) {
+        srand(seed);
+        unsigned ground=4+rand()%8;
+        for (unsigned z=0;z<chunk_edge;++z) {
+            for (unsigned y=0;y<chunk_edge;++y) {
+                for (unsigned x=0;x<chunk_edge;++x) {
+                    Node n=Node();
+                    if (y<ground) {
+                        n.blockId=(rand()%50==0)?3:1;
+                    } else if (y==ground) {
+                        n.blockId=2;
+                        if (rand()%20==0)
+                            n.deco_above_block=7;
+                    } else {
+                        n.blkLight=15;
+                    }
+                    cells[cellIndex(x,y,z)]=n;
+                }
+            }
+        }
+    }
+
+    /**
+    *   @brief inside of a ship: hull, decks every four cells,
+    *   bulkheads splitting rooms, scattered fittings, lamps
+    *   and lighting that falls off away from them.
+    */
+    inline void shipInterior(Node *cells,unsigned seed) {
+        srand(seed);
+        unsigned hull=20+rand()%4;
+        unsigned deck=30+rand()%4;
+        unsigned bulkhead=4+rand()%8;
+        for (unsigned z=0;z<chunk_edge;++z) {
+            for (unsigned y=0;y<chunk_edge;++y) {
+                for (unsigned x=0;x<chunk_edge;++x) {
+                    Node n=Node();
+                    if (z==0 || z==chunk_edge-1) {
+                        n.blockId=hull;
+                    } else if (y%4==0) {
+                        n.blockId=deck;
+                    } else if (x==bulkhead) {
+                        // doorway in each bulkhead
+                        n.blockId=(z>=6 && z<8 && y%4!=3)?0:hull+4;
+                    } else if (y%4==1 && rand()%12==0) {
+                        n.blockId=40+rand()%24;
+                        n.flags=rand()%4;
+                    } else if (y%4==3 && x%6==2 && z%6==2) {
+                        n.blockId=70;
+                        n.blkLight=15;
+                    } else {
+                        unsigned dx=(x%6>2)?x%6-2:2-x%6;
+                        unsigned dz=(z%6>2)?z%6-2:2-z%6;
+                        n.blkLight=(dx+dz>=12)?3:15-dx-dz;
+                    }
+                    if (n.blockId==deck && rand()%30==0)
+                        n.deco_above_block=80+rand()%4;
+                    cells[cellIndex(x,y,z)]=n;
+                }
+            }
+        }
+    }
+
+}
+
+#endif // BV_BENCH_CORPUS_HPP_INCLUDED
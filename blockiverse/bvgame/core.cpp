@@ -19,6 +19,8 @@
 
 #include "../common.hpp"
 #include "core.hpp"
+#include <algorithm>
+#include <set>
 #include <vector>
 
 namespace bvgame {
@@ -37,36 +39,57 @@ namespace bvgame {
     typedef std::vector<propSlot> propList;
     typedef std::map<string,s64> enumList;
 
-    const char* queryHasModule=
-        "SELECT "
-            "moduleId "
-        "FROM "
-            "Modules "
-        "WHERE "
-            "name=?1";
-    const char* queryAddModule=
-        "INSERT "
-            "INTO Modules "
-                "(name,description) "
-            "VALUES "
-                "(?1,?2)";
-
-    string queryDelRsvd(const char *tbl,const char *col) {
+    typedef std::pair<string,string> moduleSlot;
+    typedef std::vector<moduleSlot> moduleList;
+
+    /**
+    *   @brief rows per multi-row statement
+    *   (keeps bound parameters under SQLite's default limit of 999)
+    *
+    *   Multi-row statements are only run at startup so they are
+    *   prepared by text on the init connection, not interned
+    *   (which would have every pooled connection compile them).
+    */
+    const size_t rows_per_statement=300;
+
+    /** @brief ",(?a,?b)" for each row, numbering on from first */
+    string valueRows(size_t rows,size_t cols,size_t first) {
         string s;
-        s="DELETE FROM ";
-        s+=tbl;
-        s+=" WHERE ";
-        s+=col;
-        s+="=?2 AND NOT ownerMod=?1";
+        for (size_t r=0;r<rows;++r) {
+            s+=(r==0)?"(":",(";
+            for (size_t c=0;c<cols;++c) {
+                if (c>0)
+                    s+=",";
+                s+="?"+std::to_string(first+r*cols+c);
+            }
+            s+=")";
+        }
         return s;
     }
-    string queryChkRsvd(const char *tbl,const char *col) {
+    /** @brief "?first,...,?(first+n-1)" */
+    string paramList(size_t n,size_t first) {
         string s;
-        s="SELECT * FROM ";
+        for (size_t i=0;i<n;++i) {
+            if (i>0)
+                s+=",";
+            s+="?"+std::to_string(first+i);
+        }
+        return s;
+    }
+
+    string queryAddModules(size_t n) {
+        return "INSERT OR IGNORE INTO Modules (name,description) VALUES "+valueRows(n,2,1);
+    }
+    string queryFindModules(size_t n) {
+        return "SELECT moduleId,name FROM Modules WHERE name IN ("+paramList(n,1)+")";
+    }
+    string queryDelRsvd(const char *tbl,const char *col,size_t n) {
+        string s;
+        s="DELETE FROM ";
         s+=tbl;
-        s+=" WHERE ownerMod=?1 AND ";
+        s+=" WHERE ";
         s+=col;
-        s+="=?2";
+        s+=" IN ("+paramList(n,2)+") AND NOT ownerMod=?1";
         return s;
     }
     string queryEnumRsvd(const char *tbl) {
@@ -76,74 +99,68 @@ namespace bvgame {
         s+=" WHERE ownerMod=?1";
         return s;
     }
-    string queryAddRsvd(const char *tbl,const char *col) {
+    string queryAddRsvd(const char *tbl,const char *col,size_t n) {
+        // names are UNIQUE so those already owned are left alone
         string s;
-        s="INSERT INTO ";
+        s="INSERT OR IGNORE INTO ";
         s+=tbl;
         s+=" (ownerMod,";
         s+=col;
-        s+=") VALUES (?1,?2)";
+        s+=") SELECT ?1,column1 FROM (VALUES "+valueRows(n,1,2)+")";
         return s;
     }
+    string queryAddProps(size_t n) {
+        // Property has no unique key so existing names are skipped
+        return "INSERT INTO Property (ownerMod,type,name) "
+               "SELECT ?1,v.column1,v.column2 FROM (VALUES "+valueRows(n,2,2)+") AS v "
+               "WHERE NOT EXISTS "
+                   "(SELECT 1 FROM Property WHERE ownerMod=?1 AND name=v.column2)";
+    }
 
-    string queryChkProp=
-        "SELECT * "
-            "FROM "
-                "Property "
-            "WHERE "
-                "ownerMod=?1 AND name=?2";
-
-    string queryAddProp=
-        "INSERT INTO "
-            "Property "
-                "(ownerMod,type,name) "
-            "VALUES "
-                "(?1,?2,?3)";
-
-    s64 initModule(SQLiteDB &db,const string moduleName,const string moduleDesc) {
-        statement stmtHasModule;
-        statement stmtAddModule;
-        s64 modId=-1;
-        while (modId==-1) {
-            stmtHasModule=db.prepare(queryHasModule);
-            db.bind(stmtHasModule,1,moduleName);
-            query_result rsltHasModule;
-            rsltHasModule=db.loop_run(stmtHasModule);
-            if (rsltHasModule->size()>0) {
-                modId=db.get_result<s64>(rsltHasModule,0,0);
-            } else {
-                stmtAddModule=db.prepare(queryAddModule);
-                db.bind(stmtAddModule,1,moduleName);
-                db.bind(stmtAddModule,2,moduleDesc);
-                db.loop_run(stmtAddModule);
+    /**
+    *   @brief register modules (name, description) that are
+    *   not yet known, a few hundred per statement
+    *   @param ids receives the moduleId of every module listed
+    */
+    void initModules(SQLiteDB &db,const moduleList &modules,enumList &ids) {
+        for (size_t at=0;at<modules.size();at+=rows_per_statement) {
+            size_t n=std::min(rows_per_statement,modules.size()-at);
+            statement add=db.prepare(queryAddModules(n));
+            for (size_t i=0;i<n;++i) {
+                db.bind(add,int(2*i+1),modules[at+i].first);
+                db.bind(add,int(2*i+2),modules[at+i].second);
             }
+            SQLiteDB::cursor(db,add).next();
+            statement find=db.prepare(queryFindModules(n));
+            for (size_t i=0;i<n;++i)
+                db.bind(find,int(i+1),modules[at+i].first);
+            SQLiteDB::cursor found(db,find);
+            while (found.next())
+                ids[found.getString(1)]=found.getInt(0);
         }
-        return modId;
+    }
+
+    s64 initModule(SQLiteDB &db,const string moduleName,const string moduleDesc) {
+        enumList ids;
+        initModules(db,moduleList(1,moduleSlot(moduleName,moduleDesc)),ids);
+        return ids[moduleName];
     }
 
 
     void initRsvd(SQLiteDB &db,s64 ownerId,const char* tbl,const char* col, const rsvdList &rsvd) {
-        statement stmtDelRsvd;
-        statement stmtChkRsvd;
-        statement stmtAddRsvd;
-        query_result chkRslt;
-        for (auto i : rsvd) {
-            stmtDelRsvd=db.prepare(queryDelRsvd(tbl,col));
-            db.bind(stmtDelRsvd,1,ownerId);
-            db.bind(stmtDelRsvd,2,i);
-            db.loop_run(stmtDelRsvd);
-
-            stmtChkRsvd=db.prepare(queryChkRsvd(tbl,col));
-            db.bind(stmtChkRsvd,1,ownerId);
-            db.bind(stmtChkRsvd,2,i);
-            chkRslt=db.loop_run(stmtChkRsvd);
-
-            if (chkRslt->size()==0) {
-                stmtAddRsvd=db.prepare(queryAddRsvd(tbl,col));
-                db.bind(stmtAddRsvd,1,ownerId);
-                db.bind(stmtAddRsvd,2,i);
-                db.loop_run(stmtAddRsvd);
+        // names move over from other modules
+        for (size_t at=0;at<rsvd.size();at+=rows_per_statement) {
+            size_t n=std::min(rows_per_statement,rsvd.size()-at);
+            statement del=db.prepare(queryDelRsvd(tbl,col,n));
+            statement add=db.prepare(queryAddRsvd(tbl,col,n));
+            db.bind(del,1,ownerId);
+            db.bind(add,1,ownerId);
+            for (size_t i=0;i<n;++i) {
+                db.bind(del,int(i+2),rsvd[at+i]);
+                db.bind(add,int(i+2),rsvd[at+i]);
             }
+            SQLiteDB::cursor(db,del).next();
+            SQLiteDB::cursor(db,add).next();
         }
     }
     void enumRsvd(SQLiteDB &db,s64 ownerId,const char* tbl, const rsvdList &rsvd, enumList &eList) {
@@ -151,7 +168,7 @@ namespace bvgame {
         query_result enumRslt;
         s64 slotId;
         string slotName;
-        stmtEnumRsvd=db.prepare(queryEnumRsvd(tbl));
+        stmtEnumRsvd=db.prepare(bvdb::intern(queryEnumRsvd(tbl)));
         db.bind(stmtEnumRsvd,1,ownerId);
         enumRslt=db.loop_run(stmtEnumRsvd);
         for (size_t i=0;i<enumRslt->size();++i) {
@@ -165,24 +182,21 @@ namespace bvgame {
     }
 
     void initProp(SQLiteDB &db,s64 ownerId,const propList &props) {
-        statement stmtChkProp;
-        statement stmtAddProp;
-        query_result chkRslt;
-        for (auto i : props) {
-
-            stmtChkProp=db.prepare(queryChkProp);
-            db.bind(stmtChkProp,1,ownerId);
-            db.bind(stmtChkProp,2,i.second);
-            chkRslt=db.loop_run(stmtChkProp);
-
-            if (chkRslt->size()==0) {
-                s64 pType=i.first;
-                stmtAddProp=db.prepare(queryAddProp);
-                db.bind(stmtAddProp,1,ownerId);
-                db.bind(stmtAddProp,2,pType);
-                db.bind(stmtAddProp,3,i.second);
-                db.loop_run(stmtAddProp);
+        // the first of a name listed twice wins, as it would one by one
+        propList unique;
+        std::set<string> names;
+        for (auto &i : props)
+            if (names.insert(i.second).second)
+                unique.push_back(i);
+        for (size_t at=0;at<unique.size();at+=rows_per_statement) {
+            size_t n=std::min(rows_per_statement,unique.size()-at);
+            statement add=db.prepare(queryAddProps(n));
+            db.bind(add,1,ownerId);
+            for (size_t i=0;i<n;++i) {
+                db.bind(add,int(2*i+2),s64(unique[at+i].first));
+                db.bind(add,int(2*i+3),unique[at+i].second);
             }
+            SQLiteDB::cursor(db,add).next();
         }
     }
 
@@ -191,38 +205,62 @@ namespace bvgame {
         enumList PivotType;
         enumList EntityType;
 
-        const char* queryCreateEntity=
+        const bvdb::query<std::tuple<s64,s64> > queryCreateEntity={
             "INSERT INTO "
                 "Entity "
                     "(entityType,objectId) "
                 "VALUES "
-                    "(?1,?2)";
+                    "(?1,?2)"
+        };
 
-        string queryFindEntity(s64 entType) {
-            string s="SELECT * FROM Entity WHERE entityType=";
-            s+=std::to_string(entType);
-            s+=" AND objectId=?1";
-            return s;
-        }
+        /** @brief entity by type and object (entityId first) */
+        const bvdb::query<std::tuple<s64,s64>,std::tuple<s64> > queryFindEntity={
+            "SELECT "
+                "entityId "
+            "FROM "
+                "Entity "
+            "WHERE "
+                "entityType=?1 AND objectId=?2"
+        };
 
         void init(SQLiteDB &db) {
-            s64 coreId=initModule(db,
-                "core",
-                "Main internal Blockiverse game module.");
-            rsvdList rsvd;
-
-            rsvd=rsvdList({"Vehicular","Orbital","Falling"});
-            initRsvd(db,coreId,"PivotType","pivotType",rsvd);
-            enumRsvd(db,coreId,"PivotType",rsvd,PivotType);
-
-            rsvd=rsvdList({"Star","Planet","Chunkoid","Vehicle","Player","Mob"});
-            initRsvd(db,coreId,"EntityType","entityType",rsvd);
-            enumRsvd(db,coreId,"EntityType",rsvd,EntityType);
-
-            propList props;
-            //props.push_back(propSlot(SQLType::integer,"HP"));
-            //props.push_back(propSlot(SQLType::integer,"MaxHP"));
-            initProp(db,coreId,props);
+            using namespace boost::posix_time;
+            ptime start=microsec_clock::universal_time();
+            // one transaction (one sync) for all of it
+            db.runOnce("BEGIN IMMEDIATE");
+            try {
+                s64 coreId=initModule(db,
+                    "core",
+                    "Main internal Blockiverse game module.");
+                rsvdList rsvd;
+
+                rsvd=rsvdList({"Vehicular","Orbital","Falling"});
+                initRsvd(db,coreId,"PivotType","pivotType",rsvd);
+                enumRsvd(db,coreId,"PivotType",rsvd,PivotType);
+
+                rsvd=rsvdList({"Star","Planet","Chunkoid","Vehicle","Player","Mob"});
+                initRsvd(db,coreId,"EntityType","entityType",rsvd);
+                enumRsvd(db,coreId,"EntityType",rsvd,EntityType);
+
+                propList props;
+                //props.push_back(propSlot(SQLType::integer,"HP"));
+                //props.push_back(propSlot(SQLType::integer,"MaxHP"));
+                initProp(db,coreId,props);
+                db.runOnce("COMMIT");
+            } catch (std::exception &e) {
+                try {
+                    db.runOnce("ROLLBACK");
+                } catch (std::exception &ignored) {
+                    // a failed statement may already have ended it
+                }
+                throw;
+            }
+            LOCK_COUT
+            cout << "[game] core registered in "
+                 << (microsec_clock::universal_time()-start).total_milliseconds() << "ms ("
+                 << PivotType.size() << " pivot types, "
+                 << EntityType.size() << " entity types)" << endl;
+            UNLOCK_COUT
         }
 
         s64 getPlayer(SQLiteDB &db,s64 acctId) {
@@ -231,19 +269,13 @@ namespace bvgame {
             *   @param db Database handle
             *   @param acctId user account id
             *   @return id of player object */
-            while (true) {
-                statement stmt=db.prepare(queryFindEntity(EntityType["Player"]));
-                db.bind(stmt,1,acctId);
-                query_result rsltFindPlayer=db.loop_run(stmt);
-                if (rsltFindPlayer->size()>0) {
-                    return db.get_result<s64>(rsltFindPlayer,0,0);
-                }
+            s64 playerType=EntityType["Player"];
+            std::tuple<s64> player;
+            while (!db.fetch(queryFindEntity,player,playerType,acctId)) {
                 // Create player object
-                stmt=db.prepare(queryCreateEntity);
-                db.bind(stmt,1,EntityType["Player"]);
-                db.bind(stmt,2,acctId);
-                db.loop_run(stmt);
+                db.perform(queryCreateEntity,playerType,acctId);
             }
+            return std::get<0>(player);
         }
 
     }
@@ -21,6 +21,222 @@
 
 namespace bvmap {
 
-// code here
+    unsigned paletteWidth(size_t n) {
+        if (n<=1)   return 0;
+        if (n<=2)   return 1;
+        if (n<=4)   return 2;
+        if (n<=16)  return 4;
+        if (n<=256) return 8;
+        return 16;
+    }
+
+    namespace {
+        Decoration decorationOf(const Node &n) {
+            Decoration d;
+            d.above=n.deco_above_block;
+            d.below=n.deco_below_block;
+            d.infrontof=n.deco_infrontof_block;
+            d.behind=n.deco_behind_block;
+            d.leftof=n.deco_leftof_block;
+            d.rightof=n.deco_rightof_block;
+            return d;
+        }
+        void decorate(Node &n,const Decoration &d) {
+            n.deco_above_block=d.above;
+            n.deco_below_block=d.below;
+            n.deco_infrontof_block=d.infrontof;
+            n.deco_behind_block=d.behind;
+            n.deco_leftof_block=d.leftof;
+            n.deco_rightof_block=d.rightof;
+        }
+    }
+
+    Chunk::Chunk(const Node &n)
+        : blockIds(n.blockId),lights(n.blkLight),flagBits(n.flags) {
+        Decoration d=decorationOf(n);
+        if (!d.empty()) {
+            for (unsigned cell=0;cell<chunk_cells;++cell)
+                decos[cell]=d;
+        }
+    }
+
+    Node Chunk::get(unsigned cell) const {
+        Node n=Node();
+        n.blockId=blockIds.get(cell);
+        n.blkLight=lights.get(cell);
+        n.flags=flagBits.get(cell);
+        const Decoration *d=decoration(cell);
+        if (d!=NULL)
+            decorate(n,*d);
+        return n;
+    }
+
+    void Chunk::set(unsigned cell,const Node &n) {
+        blockIds.set(cell,n.blockId);
+        lights.set(cell,n.blkLight);
+        flagBits.set(cell,n.flags);
+        Decoration d=decorationOf(n);
+        if (d.empty())
+            decos.erase(cell);
+        else
+            decos[cell]=d;
+    }
+
+    void Chunk::fill(const Node &n) {
+        blockIds.fill(n.blockId);
+        lights.fill(n.blkLight);
+        flagBits.fill(n.flags);
+        decos.clear();
+        Decoration d=decorationOf(n);
+        if (!d.empty()) {
+            for (unsigned cell=0;cell<chunk_cells;++cell)
+                decos.insert(decos.end(),decoMap::value_type(cell,d));
+        }
+    }
+
+    void Chunk::pack(const Node *cells) {
+        fill(cells[0]);
+        for (unsigned cell=1;cell<chunk_cells;++cell)
+            set(cell,cells[cell]);
+        compact();
+    }
+
+    void Chunk::unpack(Node *cells) const {
+        Node blank=Node();
+        for (unsigned cell=0;cell<chunk_cells;++cell)
+            cells[cell]=blank;
+        blockIds.each([cells](unsigned cell,uint16_t v) {cells[cell].blockId=v;});
+        lights.each([cells](unsigned cell,uint8_t v) {cells[cell].blkLight=v;});
+        flagBits.each([cells](unsigned cell,uint8_t v) {cells[cell].flags=v;});
+        for (auto &d : decos)
+            decorate(cells[d.first],d.second);
+    }
+
+    namespace {
+        /** @brief serialized chunk format tag and version */
+        const char chunk_magic='C';
+        const uint8_t chunk_format=1;
+    }
+
+    void Chunk::serialize(std::string &out) const {
+        out.push_back(chunk_magic);
+        putLE<uint8_t>(out,chunk_format);
+        blockIds.write(out);
+        lights.write(out);
+        flagBits.write(out);
+        putLE<uint16_t>(out,decos.size());
+        for (auto &d : decos) {
+            putLE<uint16_t>(out,d.first);
+            putLE<uint16_t>(out,d.second.above);
+            putLE<uint16_t>(out,d.second.below);
+            putLE<uint16_t>(out,d.second.infrontof);
+            putLE<uint16_t>(out,d.second.behind);
+            putLE<uint16_t>(out,d.second.leftof);
+            putLE<uint16_t>(out,d.second.rightof);
+        }
+    }
+
+    void Chunk::deserialize(const char *data,size_t len) {
+        const char *p=data,*end=data+len;
+        if (len<2 || p[0]!=chunk_magic || (uint8_t)p[1]!=chunk_format)
+            throw ChunkFormatError("not a serialized chunk");
+        p+=2;
+        try {
+            blockIds.read(p,end);
+            lights.read(p,end);
+            flagBits.read(p,end);
+            decos.clear();
+            unsigned n=getLE<uint16_t>(p,end);
+            for (unsigned i=0;i<n;++i) {
+                unsigned cell=getLE<uint16_t>(p,end);
+                if (cell>=chunk_cells)
+                    throw ChunkFormatError("decoration cell out of range");
+                Decoration &d=decos[cell];
+                d.above=getLE<uint16_t>(p,end);
+                d.below=getLE<uint16_t>(p,end);
+                d.infrontof=getLE<uint16_t>(p,end);
+                d.behind=getLE<uint16_t>(p,end);
+                d.leftof=getLE<uint16_t>(p,end);
+                d.rightof=getLE<uint16_t>(p,end);
+            }
+            if (p!=end)
+                throw ChunkFormatError("trailing data after chunk");
+        } catch (ChunkFormatError &e) {
+            fill(Node());
+            throw;
+        }
+    }
+
+    void Chunk::compact() {
+        blockIds.compact();
+        lights.compact();
+        flagBits.compact();
+    }
+
+    void putNode(std::string &out,const Node &n) {
+        putLE<uint16_t>(out,n.blockId);
+        putLE<uint8_t>(out,n.blkLight);
+        putLE<uint8_t>(out,n.flags);
+        putLE<uint16_t>(out,n.deco_above_block);
+        putLE<uint16_t>(out,n.deco_below_block);
+        putLE<uint16_t>(out,n.deco_infrontof_block);
+        putLE<uint16_t>(out,n.deco_behind_block);
+        putLE<uint16_t>(out,n.deco_leftof_block);
+        putLE<uint16_t>(out,n.deco_rightof_block);
+    }
+
+    Node getNode(const char *&p,const char *end) {
+        Node n;
+        n.blockId=getLE<uint16_t>(p,end);
+        n.blkLight=getLE<uint8_t>(p,end);
+        n.flags=getLE<uint8_t>(p,end);
+        n.deco_above_block=getLE<uint16_t>(p,end);
+        n.deco_below_block=getLE<uint16_t>(p,end);
+        n.deco_infrontof_block=getLE<uint16_t>(p,end);
+        n.deco_behind_block=getLE<uint16_t>(p,end);
+        n.deco_leftof_block=getLE<uint16_t>(p,end);
+        n.deco_rightof_block=getLE<uint16_t>(p,end);
+        return n;
+    }
+
+    void encodeDelta(const cellEdits &cells,std::string &out) {
+        struct run {
+            unsigned first,count;
+            Node n;
+        };
+        std::vector<run> runs;
+        for (auto &c : cells) {
+            if (!runs.empty()) {
+                run &last=runs.back();
+                if (last.first+last.count==c.first && last.n==c.second) {
+                    ++last.count;
+                    continue;
+                }
+            }
+            runs.push_back(run{c.first,1,c.second});
+        }
+        putLE<uint16_t>(out,runs.size());
+        for (auto &r : runs) {
+            putLE<uint16_t>(out,r.first);
+            putLE<uint16_t>(out,r.count);
+            putNode(out,r.n);
+        }
+    }
+
+    void applyDelta(Chunk &c,const char *data,size_t len) {
+        const char *p=data,*end=data+len;
+        unsigned runs=getLE<uint16_t>(p,end);
+        for (unsigned i=0;i<runs;++i) {
+            unsigned first=getLE<uint16_t>(p,end);
+            unsigned count=getLE<uint16_t>(p,end);
+            Node n=getNode(p,end);
+            if (first+count>chunk_cells)
+                throw ChunkFormatError("delta run out of range");
+            for (unsigned cell=first;cell<first+count;++cell)
+                c.set(cell,n);
+        }
+        if (p!=end)
+            throw ChunkFormatError("trailing data after delta");
+    }
 
 }
@@ -20,9 +20,47 @@
 #define BV_CHUNK_HPP_INCLUDED
 
 #include <inttypes.h>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace bvmap {
 
+    /** @brief cells along each edge of a chunk */
+    const unsigned chunk_edge=16;
+    /** @brief cells in a chunk */
+    const unsigned chunk_cells=chunk_edge*chunk_edge*chunk_edge;
+    /** @brief chunks visible in each direction from the viewer's chunk */
+    const int view_dist=16;
+
+    /** @brief cell index of chunk-local coordinates (x fastest) */
+    inline unsigned cellIndex(unsigned x,unsigned y,unsigned z) {
+        return (z*chunk_edge+y)*chunk_edge+x;
+    }
+
+    /** @brief serialized chunk is malformed or of an unknown format */
+    struct ChunkFormatError : public std::runtime_error {
+        ChunkFormatError(const char *msg) : std::runtime_error(msg) {}
+    };
+
+    /** @brief append v to out little-endian */
+    template<typename T>
+    void putLE(std::string &out,T v) {
+        for (size_t i=0;i<sizeof(T);++i)
+            out.push_back(char((uint64_t(v)>>(8*i))&0xff));
+    }
+    /** @brief read little-endian value at p (advanced) */
+    template<typename T>
+    T getLE(const char *&p,const char *end) {
+        if (size_t(end-p)<sizeof(T))
+            throw ChunkFormatError("serialized chunk truncated");
+        uint64_t v=0;
+        for (size_t i=0;i<sizeof(T);++i)
+            v|=uint64_t((unsigned char)*p++)<<(8*i);
+        return T(v);
+    }
 
     class Node {
     public:
@@ -41,12 +79,413 @@ namespace bvmap {
         uint16_t deco_leftof_block;
         /** @brief decoration to right of this block (0 if none) */
         uint16_t deco_rightof_block;
+
+        // no padding so the whole node compares bytewise
+        bool operator==(const Node &o) const {return memcmp(this,&o,sizeof(Node))==0;}
+        bool operator!=(const Node &o) const {return !(*this==o);}
+    };
+
+    /** @brief decorations of one cell, kept apart from the block data */
+    struct Decoration {
+        uint16_t above;
+        uint16_t below;
+        uint16_t infrontof;
+        uint16_t behind;
+        uint16_t leftof;
+        uint16_t rightof;
+
+        bool empty() const {
+            return (above|below|infrontof|behind|leftof|rightof)==0;
+        }
+    };
+
+    /** @brief narrowest palette index width (0,1,2,4,8,16) holding n entries */
+    unsigned paletteWidth(size_t n);
+
+    /**
+    *   @brief one value per cell stored as palette plus packed indices.
+    *
+    *   Each distinct value in the plane has one palette entry and
+    *   each cell is an index into the palette packed 0, 1, 2, 4, 8
+    *   or 16 bits wide (the narrowest that holds the palette).  A
+    *   plane of a single value (all air, full light) needs no
+    *   indices at all.  The palette grows as new values are set and
+    *   entries no cell uses any more are reused, and once few enough
+    *   remain the plane is compacted down to a narrower index width.
+    */
+    template<typename T>
+    class PackedPlane {
+    private:
+        std::vector<T> palette;
+        /** @brief cells using each palette entry (0=free entry) */
+        std::vector<uint16_t> users;
+        /** @brief packed palette indices (none when uniform) */
+        std::vector<uint64_t> bits;
+        /** @brief bits per cell index */
+        unsigned width;
+        /** @brief palette entries in use */
+        unsigned live;
+
+        static size_t wordsFor(unsigned width) {
+            return (chunk_cells*width+63)/64;
+        }
+        unsigned indexAt(unsigned cell) const {
+            if (width==0)
+                return 0;
+            unsigned at=cell*width;
+            return (bits[at>>6]>>(at&63))&((1u<<width)-1);
+        }
+        void storeIndex(unsigned cell,unsigned idx) {
+            unsigned at=cell*width;
+            uint64_t mask=uint64_t((1u<<width)-1)<<(at&63);
+            bits[at>>6]=(bits[at>>6]&~mask)|(uint64_t(idx)<<(at&63));
+        }
+
+        /** @brief palette entry for v, adding (and widening) if needed */
+        unsigned entryFor(const T &v) {
+            size_t freeEntry=palette.size();
+            for (size_t i=0;i<palette.size();++i) {
+                if (users[i]==0) {
+                    if (freeEntry==palette.size())
+                        freeEntry=i;
+                } else if (palette[i]==v) {
+                    return i;
+                }
+            }
+            if (freeEntry<palette.size()) {
+                palette[freeEntry]=v;
+                return freeEntry;
+            }
+            unsigned idx=palette.size();
+            palette.push_back(v);
+            users.push_back(0);
+            unsigned need=paletteWidth(palette.size());
+            if (need>width) {
+                // widening keeps every index as is
+                std::vector<unsigned> same(palette.size());
+                for (size_t i=0;i<same.size();++i)
+                    same[i]=i;
+                repack(need,same);
+            }
+            return idx;
+        }
+
+        void repack(unsigned newWidth,const std::vector<unsigned> &remap) {
+            std::vector<uint64_t> packed(wordsFor(newWidth),0);
+            if (newWidth>0) {
+                for (unsigned cell=0;cell<chunk_cells;++cell) {
+                    unsigned at=cell*newWidth;
+                    packed[at>>6]|=uint64_t(remap[indexAt(cell)])<<(at&63);
+                }
+            }
+            bits.swap(packed);
+            width=newWidth;
+        }
+
+    public:
+        /** @brief uniform plane of v */
+        explicit PackedPlane(const T &v=T())
+            : palette(1,v),users(1,chunk_cells),width(0),live(1) {
+        }
+
+        const T &get(unsigned cell) const {return palette[indexAt(cell)];}
+
+        /** @brief change one cell, growing or shrinking the palette as needed */
+        void set(unsigned cell,const T &v) {
+            unsigned old=indexAt(cell);
+            if (palette[old]==v)
+                return;
+            unsigned idx=entryFor(v);
+            storeIndex(cell,idx);
+            if (users[idx]++==0)
+                ++live;
+            if (--users[old]==0)
+                --live;
+            // compact only once the narrower width would be at most
+            // half full so a plane edited back and forth across a
+            // width boundary does not repack on every change
+            unsigned fits=paletteWidth(live);
+            if (live==1 || (fits<width && live<=(1u<<fits)/2))
+                compact();
+        }
+
+        /** @brief make every cell v (back to the uniform form) */
+        void fill(const T &v) {
+            palette.assign(1,v);
+            users.assign(1,chunk_cells);
+            std::vector<uint64_t>().swap(bits);
+            width=0;
+            live=1;
+        }
+
+        /** @brief drop unused palette entries and narrow the index width */
+        void compact() {
+            std::vector<unsigned> remap(palette.size(),0);
+            std::vector<T> keptValues;
+            std::vector<uint16_t> keptUsers;
+            keptValues.reserve(live);
+            keptUsers.reserve(live);
+            for (size_t i=0;i<palette.size();++i) {
+                if (users[i]>0) {
+                    remap[i]=keptValues.size();
+                    keptValues.push_back(palette[i]);
+                    keptUsers.push_back(users[i]);
+                }
+            }
+            repack(paletteWidth(keptValues.size()),remap);
+            palette.swap(keptValues);
+            users.swap(keptUsers);
+            live=palette.size();
+        }
+
+        /**
+        *   @brief call f(cell,value) for every cell in index order.
+        *
+        *   Walks the packed words directly, so a full scan reads
+        *   chunk_cells*width bits rather than one lookup per cell.
+        */
+        template<typename F>
+        void each(F f) const {
+            if (width==0) {
+                const T &v=palette[0];
+                for (unsigned cell=0;cell<chunk_cells;++cell)
+                    f(cell,v);
+                return;
+            }
+            const unsigned per=64/width;
+            const uint64_t mask=(1u<<width)-1;
+            unsigned cell=0;
+            for (size_t w=0;w<bits.size();++w) {
+                uint64_t word=bits[w];
+                for (unsigned k=0;k<per;++k,word>>=width)
+                    f(cell++,palette[word&mask]);
+            }
+        }
+
+        /**
+        *   @brief append canonical serialized form to out.
+        *
+        *   Palette entries are written in order of first use by
+        *   cell index at the narrowest width, so planes holding the
+        *   same values serialize identically however they were
+        *   edited.  Layout: u8 width, u16 entries, entries values,
+        *   then the packed indices as little-endian u64 words.
+        */
+        void write(std::string &out) const {
+            std::vector<unsigned> order(palette.size(),~0u);
+            std::vector<unsigned> idx(chunk_cells);
+            std::vector<T> seen;
+            for (unsigned cell=0;cell<chunk_cells;++cell) {
+                unsigned e=indexAt(cell);
+                if (order[e]==~0u) {
+                    order[e]=seen.size();
+                    seen.push_back(palette[e]);
+                }
+                idx[cell]=order[e];
+            }
+            unsigned w=paletteWidth(seen.size());
+            putLE<uint8_t>(out,w);
+            putLE<uint16_t>(out,seen.size());
+            for (auto &v : seen)
+                putLE<T>(out,v);
+            std::vector<uint64_t> packed(wordsFor(w),0);
+            for (unsigned cell=0;w>0 && cell<chunk_cells;++cell) {
+                unsigned at=cell*w;
+                packed[at>>6]|=uint64_t(idx[cell])<<(at&63);
+            }
+            for (auto word : packed)
+                putLE<uint64_t>(out,word);
+        }
+
+        /** @brief replace contents from serialized form at p (advanced) */
+        void read(const char *&p,const char *end) {
+            unsigned w=getLE<uint8_t>(p,end);
+            unsigned n=getLE<uint16_t>(p,end);
+            if (n==0 || n>chunk_cells || paletteWidth(n)!=w)
+                throw ChunkFormatError("bad plane palette");
+            std::vector<T> values(n);
+            for (auto &v : values)
+                v=getLE<T>(p,end);
+            std::vector<uint64_t> packed(wordsFor(w));
+            for (auto &word : packed)
+                word=getLE<uint64_t>(p,end);
+            std::vector<uint16_t> counts(n,0);
+            palette.swap(values);
+            bits.swap(packed);
+            width=w;
+            for (unsigned cell=0;cell<chunk_cells;++cell) {
+                unsigned e=indexAt(cell);
+                if (e>=n) {
+                    fill(T());
+                    throw ChunkFormatError("plane index out of range");
+                }
+                ++counts[e];
+            }
+            users.swap(counts);
+            live=0;
+            for (auto u : users)
+                live+=(u>0);
+        }
+
+        /** @brief true when all cells hold the same value */
+        bool uniform() const {return width==0;}
+        /** @brief distinct values in the plane */
+        unsigned distinct() const {return live;}
+        /** @brief bits per cell index (0,1,2,4,8 or 16) */
+        unsigned cellBits() const {return width;}
+        /** @brief heap bytes held (not counting the plane object) */
+        size_t heapBytes() const {
+            return palette.capacity()*sizeof(T)
+                +users.capacity()*sizeof(uint16_t)
+                +bits.capacity()*sizeof(uint64_t);
+        }
     };
 
+    /**
+    *   @brief field tags for layout-independent cell access.
+    *
+    *   Code templated on a tag reads the same field from a
+    *   Chunk (via Chunk::get<F>/each<F>) or from a dense Node
+    *   array (via cellGet<F>/cellEach<F>).
+    */
+    namespace field {
+        struct blockId {
+            typedef uint16_t type;
+            static type of(const Node &n) {return n.blockId;}
+        };
+        struct light {
+            typedef uint8_t type;
+            static type of(const Node &n) {return n.blkLight;}
+        };
+        struct flags {
+            typedef uint8_t type;
+            static type of(const Node &n) {return n.flags;}
+        };
+    }
+
+    /** @brief field F of a cell in a dense Node array */
+    template<typename F>
+    typename F::type cellGet(const Node *cells,unsigned cell) {
+        return F::of(cells[cell]);
+    }
+
+    /** @brief call f(cell,value) for field F of every cell in a dense Node array */
+    template<typename F,typename Fn>
+    void cellEach(const Node *cells,Fn f) {
+        for (unsigned cell=0;cell<chunk_cells;++cell)
+            f(cell,F::of(cells[cell]));
+    }
+
+    /** @brief append node to out (16 bytes little-endian) */
+    void putNode(std::string &out,const Node &n);
+    /** @brief read node written by putNode at p (advanced) */
+    Node getNode(const char *&p,const char *end);
+
+    /**
+    *   @brief 16x16x16 cells stored as separate planes.
+    *
+    *   Block ids, light and flags each live in their own
+    *   PackedPlane so a scan over one of them touches only that
+    *   plane.  Decorations are almost always absent and are kept
+    *   in a sparse map keyed by cell index.
+    */
     class Chunk {
-        Node cells[16*16*16];
+    public:
+        typedef std::map<uint16_t,Decoration> decoMap;
+
+    private:
+        PackedPlane<uint16_t> blockIds;
+        PackedPlane<uint8_t> lights;
+        PackedPlane<uint8_t> flagBits;
+        decoMap decos;
+
+        const PackedPlane<uint16_t> &planeOf(field::blockId) const {return blockIds;}
+        const PackedPlane<uint8_t> &planeOf(field::light) const {return lights;}
+        const PackedPlane<uint8_t> &planeOf(field::flags) const {return flagBits;}
+        PackedPlane<uint16_t> &planeOf(field::blockId) {return blockIds;}
+        PackedPlane<uint8_t> &planeOf(field::light) {return lights;}
+        PackedPlane<uint8_t> &planeOf(field::flags) {return flagBits;}
+
+    public:
+        /** @brief uniform chunk of n (default all air) */
+        explicit Chunk(const Node &n=Node());
+
+        /** @brief field F of cell (see cellIndex) */
+        template<typename F>
+        typename F::type get(unsigned cell) const {return planeOf(F()).get(cell);}
+        /** @brief set field F of cell leaving the other fields alone */
+        template<typename F>
+        void set(unsigned cell,typename F::type v) {planeOf(F()).set(cell,v);}
+        /** @brief call f(cell,value) for field F of every cell */
+        template<typename F,typename Fn>
+        void each(Fn f) const {planeOf(F()).each(f);}
+
+        /** @brief whole node at cell index */
+        Node get(unsigned cell) const;
+        Node get(unsigned x,unsigned y,unsigned z) const {return get(cellIndex(x,y,z));}
+
+        /** @brief change one cell */
+        void set(unsigned cell,const Node &n);
+        void set(unsigned x,unsigned y,unsigned z,const Node &n) {set(cellIndex(x,y,z),n);}
+
+        /** @brief decoration of cell (NULL if none) */
+        const Decoration *decoration(unsigned cell) const {
+            decoMap::const_iterator i=decos.find(cell);
+            return (i==decos.end())?NULL:&i->second;
+        }
+        /** @brief all decorated cells */
+        const decoMap &decorations() const {return decos;}
+
+        /** @brief make every cell n (back to the uniform form) */
+        void fill(const Node &n);
+
+        /** @brief load from chunk_cells dense nodes */
+        void pack(const Node *cells);
+        /** @brief expand into chunk_cells dense nodes */
+        void unpack(Node *cells) const;
+
+        /**
+        *   @brief append compact binary form to out.
+        *
+        *   Canonical: chunks with the same cells serialize to the
+        *   same bytes, so the result can be used as a content key.
+        */
+        void serialize(std::string &out) const;
+        /** @brief replace contents from serialize() output @throw ChunkFormatError */
+        void deserialize(const char *data,size_t len);
+
+        /** @brief drop unused palette entries in every plane */
+        void compact();
+
+        /** @brief true when all cells hold the same Node */
+        bool uniform() const {
+            return blockIds.uniform() && lights.uniform()
+                && flagBits.uniform() && decos.empty();
+        }
+        /** @brief bytes held including the object itself */
+        size_t footprint() const {
+            // map nodes carry key, value and about four pointers
+            return sizeof(Chunk)
+                +blockIds.heapBytes()+lights.heapBytes()+flagBits.heapBytes()
+                +decos.size()*(sizeof(decoMap::value_type)+4*sizeof(void*));
+        }
     };
 
+    /** @brief new nodes by cell index for a delta */
+    typedef std::map<uint16_t,Node> cellEdits;
+
+    /**
+    *   @brief append delta setting the given cells to out.
+    *
+    *   Consecutive cells set to the same node become one run so
+    *   filling a row or a column costs no more than one cell.
+    *   Layout: u16 runs, then per run u16 first cell, u16 cells,
+    *   node (see putNode).
+    */
+    void encodeDelta(const cellEdits &cells,std::string &out);
+    /** @brief apply delta from encodeDelta @throw ChunkFormatError */
+    void applyDelta(Chunk &c,const char *data,size_t len);
+
 }
 
 #endif // BV_CHUNK_HPP_INCLUDED
@@ -0,0 +1,296 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file chunkcodec.cpp
+**
+**  Compression of serialized chunks
+**
+*/
+
+#include "chunkcodec.hpp"
+
+namespace bvmap {
+
+    namespace {
+
+        /** @brief packed chunk tag */
+        const char packed_magic='Z';
+        /** @brief tag, codec and serialized length */
+        const size_t packed_header=6;
+
+        class NoCodec : public ChunkCodec {
+        public:
+            codec_id id() const {return codec_none;}
+            const char *name() const {return "none";}
+            void compress(const char *in,size_t len,std::string &out) const {
+                out.append(in,len);
+            }
+            void decompress(const char *in,size_t len,size_t raw,std::string &out) const {
+                if (len!=raw)
+                    throw ChunkFormatError("stored chunk has the wrong length");
+                out.append(in,len);
+            }
+        };
+
+        /**
+        *   Control byte c<128 is followed by c+1 literal bytes,
+        *   c>=128 by one byte repeated c-126 times.  Bit-packed
+        *   planes turn a run of one palette index into a run of
+        *   one byte value so runs of cells compress down to a
+        *   couple of bytes per 129.
+        */
+        class RleCodec : public ChunkCodec {
+            static const size_t max_literal=128;
+            static const size_t max_run=129;
+            static const size_t min_run=3;
+        public:
+            codec_id id() const {return codec_rle;}
+            const char *name() const {return "rle";}
+            void compress(const char *in,size_t len,std::string &out) const {
+                size_t i=0,lit=0;
+                while (i<len) {
+                    size_t run=1;
+                    while (i+run<len && run<max_run && in[i+run]==in[i])
+                        ++run;
+                    if (run>=min_run) {
+                        if (lit<i) {
+                            out.push_back(char(i-lit-1));
+                            out.append(in+lit,i-lit);
+                        }
+                        out.push_back(char(run+126));
+                        out.push_back(in[i]);
+                        i+=run;
+                        lit=i;
+                    } else {
+                        i+=run;
+                        while (i-lit>=max_literal) {
+                            out.push_back(char(max_literal-1));
+                            out.append(in+lit,max_literal);
+                            lit+=max_literal;
+                        }
+                    }
+                }
+                if (lit<len) {
+                    out.push_back(char(len-lit-1));
+                    out.append(in+lit,len-lit);
+                }
+            }
+            void decompress(const char *in,size_t len,size_t raw,std::string &out) const {
+                const char *end=in+len;
+                size_t limit=out.size()+raw;
+                while (in<end) {
+                    unsigned ctl=(unsigned char)*in++;
+                    if (ctl<128) {
+                        size_t n=ctl+1;
+                        if (size_t(end-in)<n || out.size()+n>limit)
+                            throw ChunkFormatError("rle literal overruns chunk");
+                        out.append(in,n);
+                        in+=n;
+                    } else {
+                        size_t n=ctl-126;
+                        if (in==end || out.size()+n>limit)
+                            throw ChunkFormatError("rle run overruns chunk");
+                        out.append(n,*in++);
+                    }
+                }
+                if (out.size()!=limit)
+                    throw ChunkFormatError("rle chunk short");
+            }
+        };
+
+        /**
+        *   LZ77 in the style of an LZ4 block: each sequence is a
+        *   token (literal count in the high nibble, match length-4
+        *   in the low, 15 meaning more length bytes follow), the
+        *   literals, then a 16 bit back reference.  The last
+        *   sequence has literals only.  Matches are found through
+        *   a single-probe hash of the next four bytes, which keeps
+        *   compression fast at some cost in ratio.
+        */
+        class LzCodec : public ChunkCodec {
+            static const unsigned hash_bits=12;
+            static const size_t min_match=4;
+            static const size_t max_offset=0xffff;
+
+            static uint32_t read32(const char *p) {
+                uint32_t v;
+                memcpy(&v,p,sizeof(v));
+                return v;
+            }
+            static void putLength(std::string &out,size_t n) {
+                for (;n>=255;n-=255)
+                    out.push_back(char(255));
+                out.push_back(char(n));
+            }
+            static size_t getLength(const char *&p,const char *end,size_t n) {
+                if (n<15)
+                    return n;
+                unsigned char b;
+                do {
+                    if (p==end)
+                        throw ChunkFormatError("lz length truncated");
+                    b=*p++;
+                    n+=b;
+                } while (b==255 && n<=max_chunk_bytes);
+                return n;
+            }
+            static void sequence(std::string &out,const char *lit,size_t nlit,size_t match) {
+                size_t m=match?match-min_match:0;
+                out.push_back(char(((nlit<15?nlit:15)<<4)|(m<15?m:15)));
+                if (nlit>=15)
+                    putLength(out,nlit-15);
+                out.append(lit,nlit);
+            }
+        public:
+            codec_id id() const {return codec_lz;}
+            const char *name() const {return "lz";}
+            void compress(const char *in,size_t len,std::string &out) const {
+                int32_t table[1<<hash_bits];
+                for (size_t h=0;h<(size_t(1)<<hash_bits);++h)
+                    table[h]=-1;
+                size_t i=0,anchor=0;
+                while (i+min_match<=len) {
+                    uint32_t seq=read32(in+i);
+                    uint32_t h=(seq*2654435761u)>>(32-hash_bits);
+                    int32_t cand=table[h];
+                    table[h]=int32_t(i);
+                    if (cand<0 || i-cand>max_offset || read32(in+cand)!=seq) {
+                        ++i;
+                        continue;
+                    }
+                    size_t m=min_match;
+                    while (i+m<len && in[cand+m]==in[i+m])
+                        ++m;
+                    sequence(out,in+anchor,i-anchor,m);
+                    size_t off=i-cand;
+                    out.push_back(char(off&0xff));
+                    out.push_back(char(off>>8));
+                    if (m-min_match>=15)
+                        putLength(out,m-min_match-15);
+                    i+=m;
+                    anchor=i;
+                }
+                sequence(out,in+anchor,len-anchor,0);
+            }
+            void decompress(const char *in,size_t len,size_t raw,std::string &out) const {
+                const char *end=in+len;
+                size_t base=out.size();
+                out.resize(base+raw);
+                char *start=&out[0]+base,*dst=start,*limit=start+raw;
+                while (in<end) {
+                    unsigned token=(unsigned char)*in++;
+                    size_t nlit=getLength(in,end,token>>4);
+                    if (size_t(end-in)<nlit || size_t(limit-dst)<nlit)
+                        throw ChunkFormatError("lz literals overrun chunk");
+                    memcpy(dst,in,nlit);
+                    dst+=nlit;
+                    in+=nlit;
+                    if (in==end)
+                        break;
+                    if (end-in<2)
+                        throw ChunkFormatError("lz offset truncated");
+                    size_t off=(unsigned char)in[0]|(size_t((unsigned char)in[1])<<8);
+                    in+=2;
+                    size_t m=getLength(in,end,token&15)+min_match;
+                    if (off==0 || off>size_t(dst-start) || size_t(limit-dst)<m)
+                        throw ChunkFormatError("lz match out of range");
+                    const char *from=dst-off;
+                    if (off>=m) {
+                        memcpy(dst,from,m);
+                        dst+=m;
+                    } else {
+                        // overlapping match repeats the last off bytes
+                        for (size_t k=0;k<m;++k)
+                            *dst++=from[k];
+                    }
+                }
+                if (dst!=limit)
+                    throw ChunkFormatError("lz chunk short");
+            }
+        };
+
+        const NoCodec noCodec;
+        const RleCodec rleCodec;
+        const LzCodec lzCodec;
+
+    }
+
+    const std::vector<const ChunkCodec*> &allCodecs() {
+        static const ChunkCodec *const list[]={&noCodec,&rleCodec,&lzCodec};
+        static const std::vector<const ChunkCodec*> codecs(list,list+3);
+        return codecs;
+    }
+
+    const ChunkCodec *findCodec(unsigned id) {
+        const std::vector<const ChunkCodec*> &codecs=allCodecs();
+        return (id<codecs.size())?codecs[id]:NULL;
+    }
+
+    const ChunkCodec *findCodec(const std::string &name) {
+        for (const ChunkCodec *c : allCodecs())
+            if (name==c->name())
+                return c;
+        return NULL;
+    }
+
+    void packSerialized(const std::string &raw,codec_id codec,std::string &out) {
+        const ChunkCodec *method=findCodec(codec);
+        if (method==NULL)
+            throw std::invalid_argument("unknown chunk codec");
+        size_t head=out.size();
+        out.push_back(packed_magic);
+        putLE<uint8_t>(out,codec);
+        putLE<uint32_t>(out,raw.size());
+        method->compress(raw.data(),raw.size(),out);
+        if (codec!=codec_none && out.size()-head-packed_header>=raw.size()) {
+            out.resize(head);
+            packSerialized(raw,codec_none,out);
+        }
+    }
+
+    void packChunk(const Chunk &c,codec_id codec,std::string &out) {
+        std::string raw;
+        c.serialize(raw);
+        packSerialized(raw,codec,out);
+    }
+
+    codec_id packedCodec(const char *data,size_t len) {
+        if (len>=packed_header && data[0]==packed_magic && findCodec((unsigned char)data[1]))
+            return codec_id((unsigned char)data[1]);
+        return codec_none;
+    }
+
+    void unpackChunk(Chunk &c,const char *data,size_t len) {
+        if (len==0 || data[0]!=packed_magic) {
+            c.deserialize(data,len);
+            return;
+        }
+        const char *p=data+1,*end=data+len;
+        const ChunkCodec *method=findCodec(getLE<uint8_t>(p,end));
+        size_t raw=getLE<uint32_t>(p,end);
+        if (method==NULL)
+            throw ChunkFormatError("unknown chunk codec");
+        if (raw>max_chunk_bytes)
+            throw ChunkFormatError("packed chunk too large");
+        if (method->id()==codec_none) {
+            if (size_t(end-p)!=raw)
+                throw ChunkFormatError("stored chunk has the wrong length");
+            c.deserialize(p,raw);
+            return;
+        }
+        std::string serial;
+        method->decompress(p,end-p,raw,serial);
+        c.deserialize(serial.data(),serial.size());
+    }
+
+}
@@ -0,0 +1,86 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file chunkcodec.hpp
+**
+**  Compression of serialized chunks
+**
+*/
+#ifndef BV_CHUNKCODEC_HPP_INCLUDED
+#define BV_CHUNKCODEC_HPP_INCLUDED
+
+#include "chunk.hpp"
+
+namespace bvmap {
+
+    /** @brief codec ids as recorded in packed chunk headers */
+    enum codec_id {
+        codec_none=0,   /**< @brief stored as serialized */
+        codec_rle=1,    /**< @brief byte runs (runs of palette indices) */
+        codec_lz=2      /**< @brief LZ77 with a 64KiB window */
+    };
+
+    /** @brief largest serialized chunk a packed header may claim */
+    const size_t max_chunk_bytes=1<<20;
+
+    /**
+    *   @brief a compression method for serialized chunks.
+    *
+    *   Codecs are stateless and shared: use findCodec() to get
+    *   one.  Output must be deterministic so that equal chunks
+    *   packed with the same codec give equal blobs.
+    */
+    class ChunkCodec {
+    public:
+        virtual ~ChunkCodec() {}
+        virtual codec_id id() const=0;
+        virtual const char *name() const=0;
+        /** @brief append compressed form of in[0..len) to out */
+        virtual void compress(const char *in,size_t len,std::string &out) const=0;
+        /**
+        *   @brief append the raw bytes compressed in in[0..len) to out
+        *   @param raw exact size of the decompressed data
+        *   @throw ChunkFormatError if the data does not decode to raw bytes
+        */
+        virtual void decompress(const char *in,size_t len,size_t raw,std::string &out) const=0;
+    };
+
+    /** @brief codec with id (NULL if there is none) */
+    const ChunkCodec *findCodec(unsigned id);
+    /** @brief codec called name (NULL if there is none) */
+    const ChunkCodec *findCodec(const std::string &name);
+    /** @brief all codecs, ordered by id */
+    const std::vector<const ChunkCodec*> &allCodecs();
+
+    /**
+    *   @brief append c packed with codec to out.
+    *
+    *   Packed form is 'Z', codec id (u8), serialized length (u32)
+    *   and the compressed serialized chunk.  If compressing does
+    *   not save anything the chunk is packed with codec_none.
+    */
+    void packChunk(const Chunk &c,codec_id codec,std::string &out);
+    /** @brief as packChunk() from serialize() output */
+    void packSerialized(const std::string &raw,codec_id codec,std::string &out);
+    /**
+    *   @brief replace c with the chunk packed at data.
+    *   Plain serialize() output is accepted as well.
+    *   @throw ChunkFormatError
+    */
+    void unpackChunk(Chunk &c,const char *data,size_t len);
+    /** @brief codec the chunk packed at data was compressed with */
+    codec_id packedCodec(const char *data,size_t len);
+
+}
+
+#endif // BV_CHUNKCODEC_HPP_INCLUDED
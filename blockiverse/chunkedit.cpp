@@ -0,0 +1,164 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file chunkedit.cpp
+**
+**  Batched chunk edits and the delta log streamed to clients
+**
+*/
+#include "chunkedit.hpp"
+#include <boost/bind.hpp>
+
+namespace bv {
+
+    using bvmap::ChunkPos;
+
+    ChunkEditor::ChunkEditor(DBWriter &writes,size_t keep)
+        : writer(writes),db(bvdb::SQLiteDB::read_only),store(db),nextSeq(1),logMax(std::max(keep,size_t(1))),timer(NULL),ticking(false) {
+    }
+
+    ChunkEditor::~ChunkEditor() {
+        stop();
+        delete timer;
+    }
+
+    void ChunkEditor::edit(const ChunkPos &pos,unsigned cell,const bvmap::Node &n) {
+        if (cell>=bvmap::chunk_cells)
+            throw std::out_of_range("chunk cell index");
+        boost::mutex::scoped_lock hold(lock);
+        pending[pos][cell]=n;
+    }
+
+    void ChunkEditor::load(const ChunkPos &pos,bvmap::Chunk &c) {
+        string data;
+        try {
+            if (writer.pendingChunk(pos,data))
+                c.deserialize(data.data(),data.size());
+            else
+                store.load(pos,c);
+        } catch (bvmap::ChunkFormatError &e) {
+            // edits go on top of empty space rather than never landing
+            BVLOG_WARN("[edit] chunk " << pos.entityId << ':' << pos.x << ',' << pos.y << ',' << pos.z
+                       << " unreadable: " << e.what());
+            c.fill(bvmap::Node());
+        }
+    }
+
+    u32 ChunkEditor::version(const ChunkPos &pos) {
+        boost::mutex::scoped_lock hold(lock);
+        version_map::iterator v=versions.find(pos);
+        return (v==versions.end())?0:v->second;
+    }
+
+    size_t ChunkEditor::flush() {
+        boost::mutex::scoped_lock turn(flushing);
+        edit_map taken;
+        {
+            boost::mutex::scoped_lock hold(lock);
+            taken.swap(pending);
+        }
+        if (taken.empty())
+            return 0;
+        // every chunk is read before any is saved so a failed
+        // read leaves nothing half done
+        std::vector<bvmap::Chunk> edited(taken.size());
+        try {
+            size_t i=0;
+            for (auto &e : taken)
+                load(e.first,edited[i++]);
+        } catch (std::exception &e) {
+            BVLOG_WARN("[edit] flush of " << taken.size() << " chunk(s) failed: " << e.what());
+            // put back under anything edited since (newer wins)
+            boost::mutex::scoped_lock hold(lock);
+            for (auto &t : taken) {
+                bvmap::cellEdits &cells=pending[t.first];
+                cells.insert(t.second.begin(),t.second.end());
+            }
+            return 0;
+        }
+        size_t i=0;
+        for (auto &e : taken) {
+            bvmap::Chunk &c=edited[i++];
+            for (auto &cell : e.second)
+                c.set(cell.first,cell.second);
+            writer.saveChunk(e.first,c);
+        }
+        // only flush() changes versions and flushes take turns,
+        // so the lock is needed just for readers
+        boost::mutex::scoped_lock hold(lock);
+        for (auto &e : taken) {
+            u32 from=0;
+            version_map::iterator v=versions.find(e.first);
+            if (v!=versions.end())
+                from=v->second;
+            versions[e.first]=from+1;
+            log.push_back(delta_rec(nextSeq++,e.first,from,from+1));
+            bvmap::encodeDelta(e.second,log.back().data);
+        }
+        while (log.size()>logMax)
+            log.pop_front();
+        BVLOG_DEBUG("[edit] " << taken.size() << " chunk(s) changed, log at " << (nextSeq-1));
+        return taken.size();
+    }
+
+    bool ChunkEditor::since(u64 seq,delta_list &out,size_t max) {
+        boost::mutex::scoped_lock hold(lock);
+        out.clear();
+        if (log.empty())
+            return seq+1>=nextSeq;
+        u64 first=log.front().seq;
+        if (seq+1<first)
+            return false;
+        for (size_t i=seq+1-first;i<log.size() && out.size()<max;++i)
+            out.push_back(log[i]);
+        return true;
+    }
+
+    u64 ChunkEditor::head() {
+        boost::mutex::scoped_lock hold(lock);
+        return nextSeq-1;
+    }
+
+    void ChunkEditor::start(boost::asio::io_service &io,boost::posix_time::time_duration interval) {
+        boost::mutex::scoped_lock hold(lock);
+        if (timer==NULL)
+            timer=new boost::asio::deadline_timer(io);
+        period=interval;
+        ticking=true;
+        timer->expires_from_now(period);
+        timer->async_wait(boost::bind(&ChunkEditor::on_tick,this,
+            boost::asio::placeholders::error));
+    }
+
+    void ChunkEditor::stop() {
+        boost::mutex::scoped_lock hold(lock);
+        ticking=false;
+        if (timer!=NULL) {
+            boost::system::error_code ignored;
+            timer->cancel(ignored);
+        }
+    }
+
+    void ChunkEditor::on_tick(const boost::system::error_code &ec) {
+        if (ec)
+            return;
+        flush();
+        boost::mutex::scoped_lock hold(lock);
+        if (!ticking)
+            return;
+        timer->expires_from_now(period);
+        timer->async_wait(boost::bind(&ChunkEditor::on_tick,this,
+            boost::asio::placeholders::error));
+    }
+
+}
@@ -0,0 +1,128 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file chunkedit.hpp
+**
+**  Batched chunk edits and the delta log streamed to clients
+**
+*/
+#ifndef BV_CHUNKEDIT_HPP_INCLUDED
+#define BV_CHUNKEDIT_HPP_INCLUDED
+
+#include "common.hpp"
+#include "chunkstore.hpp"
+#include "dbwriter.hpp"
+#include <deque>
+#include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace bv {
+
+    /**
+    *   @brief server-wide chunk edits.
+    *
+    *   Edits are collected per chunk and applied once per tick
+    *   by flush(): every edited chunk is handed to the DBWriter
+    *   to save, its version goes up by one and a delta holding
+    *   just the changed cells is appended to the log.  Chunks
+    *   are read back through the writer first so saves it has
+    *   not committed yet are never lost or sent out of date.
+    *   Streamers pass the log on to clients holding the chunk and
+    *   fall back to resending the whole chunk when a client's
+    *   version does not match the delta or the log has moved past
+    *   it.  Versions start at 0 and live only as long as the
+    *   server runs (clients start over when they reconnect).
+    *
+    *   flush() reads the chunks without holding the lock that
+    *   edit(), version() and since() take, so a slow flush never
+    *   holds up streaming.
+    *
+    *   All members may be called from any thread.
+    */
+    class ChunkEditor : private boost::noncopyable {
+    public:
+        /** @brief one chunk's changes in one tick */
+        struct delta_rec {
+            u64 seq;                /**< @brief position in the log */
+            bvmap::ChunkPos pos;
+            u32 from;               /**< @brief version the delta applies to */
+            u32 to;                 /**< @brief version after applying it */
+            string data;            /**< @brief bvmap::encodeDelta output */
+            delta_rec(u64 s,const bvmap::ChunkPos &p,u32 f,u32 t)
+                : seq(s),pos(p),from(f),to(t) {}
+        };
+        typedef std::vector<delta_rec> delta_list;
+
+    private:
+        typedef std::map<bvmap::ChunkPos,bvmap::cellEdits> edit_map;
+        typedef std::map<bvmap::ChunkPos,u32> version_map;
+
+        boost::mutex lock;          /**< @brief guards pending, versions and log */
+        boost::mutex flushing;      /**< @brief one flush at a time (guards db and store) */
+        DBWriter &writer;
+        bvdb::SQLiteDB db;          /**< @brief own connection for reads (used under flushing) */
+        bvmap::ChunkStore store;
+        edit_map pending;           /**< @brief edits since the last flush */
+        version_map versions;       /**< @brief chunks edited since startup */
+        std::deque<delta_rec> log;  /**< @brief recent deltas, oldest first */
+        u64 nextSeq;                /**< @brief seq of the next delta logged */
+        size_t logMax;              /**< @brief deltas kept */
+        boost::asio::deadline_timer *timer;
+        boost::posix_time::time_duration period;
+        bool ticking;               /**< @brief start() called and stop() not since */
+
+        void on_tick(const boost::system::error_code &ec);
+        /** @brief current contents of chunk at pos (under flushing) */
+        void load(const bvmap::ChunkPos &pos,bvmap::Chunk &c);
+    public:
+        /**
+        *   @param writes where edited chunks are saved
+        *   @param keep most recent deltas kept for streamers to catch up from
+        */
+        explicit ChunkEditor(DBWriter &writes,size_t keep=8192);
+        ~ChunkEditor();
+
+        /** @brief set cell of chunk at pos to n on the next flush */
+        void edit(const bvmap::ChunkPos &pos,unsigned cell,const bvmap::Node &n);
+        /** @brief committed version of chunk at pos */
+        u32 version(const bvmap::ChunkPos &pos);
+        /** @brief saves of edited chunks */
+        DBWriter &writes() {return writer;}
+
+        /**
+        *   @brief apply pending edits, queue the chunks to be saved
+        *   and log the deltas
+        *   @return number of chunks changed (0 if reading a chunk
+        *   failed; the edits are then retried on the next flush)
+        */
+        size_t flush();
+
+        /**
+        *   @brief deltas logged after seq
+        *   @param seq last delta already seen (0 for none)
+        *   @param out receives at most max deltas, oldest first
+        *   @return false if deltas after seq have already left the log
+        */
+        bool since(u64 seq,delta_list &out,size_t max);
+        /** @brief seq of the newest delta logged (0 if none) */
+        u64 head();
+
+        /** @brief flush every interval on io (from its threads) */
+        void start(boost::asio::io_service &io,boost::posix_time::time_duration interval);
+        /** @brief stop flushing (pending edits stay queued) */
+        void stop();
+    };
+
+}
+
+#endif // BV_CHUNKEDIT_HPP_INCLUDED
@@ -0,0 +1,135 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file chunkstore.cpp
+**
+**  Content-addressed chunk persistence
+**
+*/
+#include "chunkstore.hpp"
+#include "queries.hpp"
+#include "sha1.hpp"
+#include <iomanip>
+#include <sstream>
+
+namespace bvmap {
+
+    using bvdb::SQLiteDB;
+
+    string chunkDigest(const string &data) {
+        SHA1 sha;
+        sha.addBytes(data.data(),data.size());
+        unsigned char *dig=sha.getDigest();
+        std::ostringstream ss;
+        for (int i=0;i<20;++i)
+            ss << std::setfill('0') << std::setw(2) << std::hex
+               << (unsigned int)dig[i];
+        free(dig);
+        return ss.str();
+    }
+
+    void ChunkStore::release(string &sha) {
+        db.perform(bvquery::unrefChunk,sha);
+        db.perform(bvquery::purgeChunk,sha);
+    }
+
+    void ChunkStore::write(const ChunkPos &pos,const string &data) {
+        s64 ent=pos.entityId,cx=pos.x,cy=pos.y,cz=pos.z;
+        bvquery::row::findChunkRef found(0,string());
+        bool had=db.fetch(bvquery::findChunkRef,found,ent,cx,cy,cz);
+        s64 refId=std::get<bvquery::result::findChunkRef::chunkRefId>(found);
+        string &oldSha=std::get<bvquery::result::findChunkRef::sha>(found);
+
+        if (data.empty()) {
+            if (had) {
+                db.perform(bvquery::dropChunkRef,refId);
+                release(oldSha);
+            }
+            return;
+        }
+
+        string sha=chunkDigest(data);
+        if (had && sha==oldSha)
+            return;
+        string packed;
+        packSerialized(data,codec,packed);
+        if (db.perform(bvquery::storeChunk,sha,bvdb::blob_ref(packed))>0)
+            ++written;
+        db.perform(bvquery::refChunk,sha);
+        if (had) {
+            db.perform(bvquery::setChunkRef,refId,sha);
+            release(oldSha);
+        } else {
+            db.perform(bvquery::addChunkRef,ent,cx,cy,cz,sha);
+        }
+    }
+
+    bool ChunkStore::load(const ChunkPos &pos,Chunk &out) {
+        pending_map::iterator queued=pending.find(pos);
+        if (queued!=pending.end()) {
+            if (queued->second.empty())
+                return false;
+            out.deserialize(queued->second.data(),queued->second.size());
+            return true;
+        }
+        string data;
+        if (!loadPacked(pos,data))
+            return false;
+        unpackChunk(out,data.data(),data.size());
+        return true;
+    }
+
+    bool ChunkStore::loadPacked(const ChunkPos &pos,string &out) {
+        pending_map::iterator queued=pending.find(pos);
+        if (queued!=pending.end()) {
+            if (queued->second.empty())
+                return false;
+            out.clear();
+            packSerialized(queued->second,codec,out);
+            return true;
+        }
+        s64 ent=pos.entityId,cx=pos.x,cy=pos.y,cz=pos.z;
+        SQLiteDB::cursor rslt(db,db.prepare(bvquery::loadChunk,ent,cx,cy,cz));
+        if (!rslt.next())
+            return false;
+        rslt.read(bvquery::result::loadChunk::data,out);
+        return true;
+    }
+
+    size_t ChunkStore::commit() {
+        if (pending.empty())
+            return 0;
+        u64 wasWritten=written;
+        db.runOnce("BEGIN IMMEDIATE");
+        try {
+            for (auto &p : pending)
+                write(p.first,p.second);
+            db.runOnce("COMMIT");
+        } catch (std::exception &e) {
+            written=wasWritten;
+            try {
+                db.runOnce("ROLLBACK");
+            } catch (std::exception &ignored) {
+                // failed statements may already have ended it
+            }
+            throw;
+        }
+        size_t n=pending.size();
+        saved+=n;
+        BVLOG_DEBUG("[DB] chunk commit: " << n << " position(s), "
+                    << (written-wasWritten) << " new chunk(s)");
+        pending.clear();
+        return n;
+    }
+
+}
@@ -0,0 +1,132 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file chunkstore.hpp
+**
+**  Content-addressed chunk persistence
+**
+*/
+#ifndef BV_CHUNKSTORE_HPP_INCLUDED
+#define BV_CHUNKSTORE_HPP_INCLUDED
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include "chunkcodec.hpp"
+#include "database.hpp"
+#include <map>
+
+namespace bvmap {
+
+    /** @brief hex SHA1 digest of data */
+    string chunkDigest(const string &data);
+
+    /** @brief position of a chunk within an entity (planet, ship, ...) */
+    struct ChunkPos {
+        s64 entityId;
+        s64 x;
+        s64 y;
+        s64 z;
+        ChunkPos(s64 ent,s64 cx,s64 cy,s64 cz)
+            : entityId(ent),x(cx),y(cy),z(cz) {}
+        bool operator<(const ChunkPos &o) const {
+            if (entityId!=o.entityId) return entityId<o.entityId;
+            if (x!=o.x) return x<o.x;
+            if (y!=o.y) return y<o.y;
+            return z<o.z;
+        }
+    };
+
+    /**
+    *   @brief Chunk persistence keyed by content.
+    *
+    *   Chunk data lives in the Chunk table under the SHA1 of its
+    *   serialized form and each position refers to it through
+    *   ChunkRef, so identical chunks (empty space, solid rock,
+    *   copies of the same ship) are stored once.  The data is
+    *   kept packed (see packChunk()) with the store's codec;
+    *   the digest is of the unpacked form so changing codecs
+    *   does not split shared chunks.  Chunk.refcount
+    *   counts the ChunkRef rows using the data and the data is
+    *   deleted when it reaches zero.
+    *
+    *   save() and erase() only queue; commit() writes everything
+    *   queued in one transaction and is meant to be called once
+    *   per tick.  Saving the same position again before a commit
+    *   replaces the queued save.
+    */
+    class ChunkStore : private boost::noncopyable {
+    private:
+        bvdb::SQLiteDB &db;
+        /** @brief codec new chunk data is packed with */
+        codec_id codec;
+        /** @brief queued save (empty data means erase) */
+        typedef std::map<ChunkPos,string> pending_map;
+        pending_map pending;
+        /** @brief chunk saves committed */
+        u64 saved;
+        /** @brief saves that stored new data (the rest were shared) */
+        u64 written;
+
+        void release(string &sha);
+
+    public:
+        explicit ChunkStore(bvdb::SQLiteDB &database,codec_id packing=codec_lz)
+            : db(database),codec(packing),saved(0),written(0) {}
+
+        /** @brief queue c to be stored at pos */
+        void save(const ChunkPos &pos,const Chunk &c) {
+            string &data=pending[pos];
+            data.clear();
+            c.serialize(data);
+        }
+        /** @brief queue removal of whatever is stored at pos */
+        void erase(const ChunkPos &pos) {
+            pending[pos].clear();
+        }
+        /**
+        *   @brief chunk at pos including saves not yet committed
+        *   @return false if nothing is stored there
+        */
+        bool load(const ChunkPos &pos,Chunk &out);
+        /**
+        *   @brief chunk at pos as packed by packChunk(), ready to
+        *   send without unpacking (not checked for damage)
+        *   @return false if nothing is stored there
+        */
+        bool loadPacked(const ChunkPos &pos,string &out);
+
+        /**
+        *   @brief write all queued saves in one transaction
+        *   @return number of positions written
+        *   @throw bvdb::DBError on failure (queue is kept for a retry)
+        */
+        size_t commit();
+
+        /**
+        *   @brief store serialized chunk data at pos right away,
+        *   empty data erasing it, in the caller's transaction
+        *   @throw bvdb::DBError
+        */
+        void write(const ChunkPos &pos,const string &data);
+
+        /** @brief saves waiting for commit() */
+        size_t queued() const {return pending.size();}
+        /** @brief chunk saves committed */
+        u64 savedCount() const {return saved;}
+        /** @brief committed saves that needed new chunk data stored */
+        u64 writtenCount() const {return written;}
+    };
+
+}
+
+#endif // BV_CHUNKSTORE_HPP_INCLUDED
@@ -0,0 +1,228 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file chunkstream.cpp
+**
+**  Streaming of chunks around a player to its client
+**
+*/
+#include "chunkstream.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+namespace bv {
+
+    using bvmap::ChunkPos;
+
+    namespace {
+
+        /** @brief budget charged per message on top of chunk data */
+        const s64 msg_overhead=32;
+
+        struct offset {
+            int8_t dx,dy,dz;
+            int dist2() const {return dx*dx+dy*dy+dz*dz;}
+            bool operator<(const offset &o) const {return dist2()<o.dist2();}
+        };
+        typedef std::vector<offset> offset_list;
+
+        boost::mutex offsets_lock;
+        std::map<int,offset_list> offsets_by_dist;
+
+        /** @brief offsets of the cube of radius dist, nearest first (shared, built once) */
+        const offset_list &nearestFirst(int dist) {
+            boost::mutex::scoped_lock hold(offsets_lock);
+            offset_list &o=offsets_by_dist[dist];
+            if (o.empty()) {
+                o.reserve((2*dist+1)*(2*dist+1)*(2*dist+1));
+                for (int z=-dist;z<=dist;++z)
+                    for (int y=-dist;y<=dist;++y)
+                        for (int x=-dist;x<=dist;++x)
+                            o.push_back(offset{int8_t(x),int8_t(y),int8_t(z)});
+                std::stable_sort(o.begin(),o.end());
+            }
+            return o;
+        }
+
+    }
+
+    string ChunkStreamer::emptyChunk() {
+        string data;
+        bvmap::packChunk(bvmap::Chunk(),bvmap::codec_none,data);
+        return data;
+    }
+
+    ChunkStreamer::ChunkStreamer(bvnet::session &sess,bvdb::SQLitePool &connections,ChunkEditor *edits,const stream_limits &lim)
+        : ctx(sess),pool(connections),editor(edits),limits(lim),placed(false),center(0,0,0,0),
+          next(0),seen(0),tokens(0),bytesSent(0),chunksSent(0),deltasSent(0),unloadsSent(0) {
+        // chunks are read as they are when sent so older deltas never matter
+        if (editor!=NULL)
+            seen=editor->head();
+        // offsets are int8
+        limits.dist=std::max(0,std::min(limits.dist,127));
+    }
+
+    bool ChunkStreamer::inRange(const ChunkPos &p) const {
+        return p.entityId==center.entityId
+            && std::abs(p.x-center.x)<=limits.dist
+            && std::abs(p.y-center.y)<=limits.dist
+            && std::abs(p.z-center.z)<=limits.dist;
+    }
+
+    void ChunkStreamer::moveTo(const ChunkPos &c) {
+        if (placed && !(c<center) && !(center<c))
+            return;
+        center=c;
+        placed=true;
+        next=0;
+        // unloads not sent yet for chunks back in range are simply kept
+        std::vector<held> still;
+        for (auto &h : unloads) {
+            if (inRange(h.first))
+                sent.insert(h);
+            else
+                still.push_back(h);
+        }
+        unloads.swap(still);
+        for (auto i=sent.begin();i!=sent.end();) {
+            if (inRange(i->first)) {
+                ++i;
+            } else {
+                unloads.push_back(*i);
+                stale.erase(i->first);
+                i=sent.erase(i);
+            }
+        }
+    }
+
+    void ChunkStreamer::sendChunk(bvmap::ChunkStore &store,const ChunkPos &p) {
+        // version is read first: data newer than its version only
+        // means a delta gets applied again, which changes nothing
+        u32 version=(editor==NULL)?0:editor->version(p);
+        // sent as stored: packed once when saved, never unpacked
+        // here; saves not committed yet are newer than the store
+        string data;
+        bool found=(editor!=NULL) && editor->writes().pendingPacked(p,data);
+        if (!found && !store.loadPacked(p,data)) {
+            // nothing stored means empty space
+            static const string empty=emptyChunk();
+            data=empty;
+        }
+        ctx.send_int(p.entityId);
+        ctx.send_int(p.x);
+        ctx.send_int(p.y);
+        ctx.send_int(p.z);
+        ctx.send_int(version);
+        ctx.send_blob(data);
+        ctx.send_call(ctx.getRemote(),"ChunkLoad");
+        sent[p]=version;
+        tokens-=data.size()+msg_overhead;
+        bytesSent+=data.size();
+        ++chunksSent;
+    }
+
+    void ChunkStreamer::catchUp() {
+        ChunkEditor::delta_list recent;
+        while (tokens>0) {
+            if (!editor->since(seen,recent,64)) {
+                // too far behind for the log: resend what changed
+                seen=editor->head();
+                for (auto &h : sent)
+                    if (editor->version(h.first)!=h.second)
+                        stale.insert(h.first);
+                continue;
+            }
+            if (recent.empty())
+                return;
+            for (auto &d : recent) {
+                if (tokens<=0)
+                    return;
+                seen=d.seq;
+                held_map::iterator h=sent.find(d.pos);
+                if (h==sent.end())
+                    continue;
+                if (h->second==d.from) {
+                    ctx.send_int(d.pos.entityId);
+                    ctx.send_int(d.pos.x);
+                    ctx.send_int(d.pos.y);
+                    ctx.send_int(d.pos.z);
+                    ctx.send_int(d.from);
+                    ctx.send_int(d.to);
+                    ctx.send_blob(d.data);
+                    ctx.send_call(ctx.getRemote(),"ChunkDelta");
+                    h->second=d.to;
+                    tokens-=d.data.size()+msg_overhead;
+                    bytesSent+=d.data.size();
+                    ++deltasSent;
+                } else if (h->second<d.to) {
+                    stale.insert(d.pos);
+                }
+            }
+        }
+    }
+
+    void ChunkStreamer::tick() {
+        if (!placed || !ctx.hasRemote())
+            return;
+        s64 refill=s64(limits.bytes_per_sec)*limits.tick_ms/1000;
+        tokens=std::min(tokens+refill,refill);
+        // unloads go first so a chunk the player returned to is
+        // never unloaded after being sent again
+        while (tokens>0 && !unloads.empty()) {
+            const ChunkPos &p=unloads.back().first;
+            ctx.send_int(p.entityId);
+            ctx.send_int(p.x);
+            ctx.send_int(p.y);
+            ctx.send_int(p.z);
+            ctx.send_call(ctx.getRemote(),"ChunkUnload");
+            unloads.pop_back();
+            tokens-=msg_overhead;
+            ++unloadsSent;
+        }
+        if (!unloads.empty())
+            return;
+        // changes to held chunks before anything new
+        if (editor!=NULL)
+            catchUp();
+        const offset_list &o=nearestFirst(limits.dist);
+        if (tokens<=0 || (stale.empty() && next>=o.size()))
+            return;
+        // never wait for a connection on an io thread: when all
+        // are lent out this tick only passes on deltas
+        bvdb::SQLitePool::lease db=pool.tryAcquire();
+        if (!db)
+            return;
+        try {
+            bvmap::ChunkStore store(*db);
+            // a chunk is only crossed off once it was sent so
+            // a failed read is tried again next tick
+            while (tokens>0 && !stale.empty()) {
+                ChunkPos p=*stale.begin();
+                if (sent.count(p)>0)
+                    sendChunk(store,p);
+                stale.erase(p);
+            }
+            while (tokens>0 && next<o.size()) {
+                const offset &d=o[next];
+                ChunkPos p(center.entityId,center.x+d.dx,center.y+d.dy,center.z+d.dz);
+                if (sent.count(p)==0)
+                    sendChunk(store,p);
+                ++next;
+            }
+        } catch (bvdb::DBError &e) {
+            BVLOG_WARN("[stream] session " << &ctx << " chunk read failed (retried next tick): " << e.what());
+        }
+    }
+
+}
@@ -0,0 +1,149 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file chunkstream.hpp
+**
+**  Streaming of chunks around a player to its client
+**
+*/
+#ifndef BV_CHUNKSTREAM_HPP_INCLUDED
+#define BV_CHUNKSTREAM_HPP_INCLUDED
+
+#include "common.hpp"
+#include "protocol.hpp"
+#include "chunkstore.hpp"
+#include "chunkedit.hpp"
+#include "dbpool.hpp"
+#include <set>
+#include <vector>
+
+namespace bv {
+
+    /** @brief per session streaming limits (see server_default_config) */
+    struct stream_limits {
+        size_t bytes_per_sec;   /**< @brief chunk data sent per second */
+        unsigned tick_ms;       /**< @brief interval between sends */
+        int dist;               /**< @brief chunks streamed in each direction */
+        unsigned edits;         /**< @brief node edits accepted per tick */
+        stream_limits()
+            : bytes_per_sec(262144),tick_ms(100),dist(bvmap::view_dist),edits(256) {}
+    };
+
+    /**
+    *   @brief keeps a client's chunks in step with its player.
+    *
+    *   The interest region is the cube of chunks within dist of
+    *   the player's chunk.  Chunks the client lacks are sent
+    *   nearest-first via the client root's ChunkLoad method and
+    *   chunks left outside the region are dropped via ChunkUnload.
+    *
+    *   Edits logged by the ChunkEditor are passed on as deltas
+    *   to chunks the client holds at the version the delta
+    *   applies to.  A chunk whose client version is behind (or
+    *   whose deltas have left the log) is resent whole.
+    *
+    *   tick() sends at most one tick's worth of the byte budget,
+    *   so a player moving fast falls behind rather than holding
+    *   the io threads away from other sessions.  Unused budget
+    *   does not carry over.  A database connection is borrowed
+    *   from the pool only for ticks that may send chunks, and
+    *   only if one is free right away; otherwise (or when a
+    *   read fails) the chunks wait for a later tick.
+    *
+    *   Client methods (remote root):
+    *       ChunkLoad(int entity,int Cx,int Cy,int Cz,int version,blob chunk)
+    *       ChunkDelta(int entity,int Cx,int Cy,int Cz,int from,int to,blob delta)
+    *       ChunkUnload(int entity,int Cx,int Cy,int Cz)
+    *   Clients report a chunk they could not load with the
+    *   account's ChunkDropped method (see forget()).
+    *   where chunk is bvmap::packChunk() output and delta
+    *   bvmap::encodeDelta() output taking version from to version to.
+    */
+    class ChunkStreamer : private boost::noncopyable {
+    private:
+        typedef std::map<bvmap::ChunkPos,u32> held_map;
+        typedef std::pair<bvmap::ChunkPos,u32> held;
+
+        bvnet::session &ctx;
+        bvdb::SQLitePool &pool;     /**< @brief where stored chunks are read */
+        ChunkEditor *editor;        /**< @brief source of deltas (may be NULL) */
+        stream_limits limits;
+        bool placed;                /**< @brief center is known */
+        bvmap::ChunkPos center;     /**< @brief player's chunk */
+        size_t next;                /**< @brief next offset (nearest-first) to consider */
+        held_map sent;              /**< @brief chunks the client holds and their versions */
+        std::vector<held> unloads;  /**< @brief unloads not yet sent */
+        std::set<bvmap::ChunkPos> stale;        /**< @brief held chunks to resend whole */
+        u64 seen;                   /**< @brief last editor delta dealt with */
+        s64 tokens;                 /**< @brief bytes that may still be sent this tick */
+        u64 bytesSent;
+        u64 chunksSent;
+        u64 deltasSent;
+        u64 unloadsSent;
+
+        bool inRange(const bvmap::ChunkPos &p) const;
+        void sendChunk(bvmap::ChunkStore &store,const bvmap::ChunkPos &p);
+        /** @brief what is sent for a position nothing is stored at */
+        static string emptyChunk();
+        /** @brief pass on logged deltas while the budget lasts */
+        void catchUp();
+    public:
+        ChunkStreamer(bvnet::session &sess,bvdb::SQLitePool &connections,ChunkEditor *edits,const stream_limits &lim);
+
+        /** @brief player is now in chunk c (queues unloads and restarts the scan) */
+        void moveTo(const bvmap::ChunkPos &c);
+        /** @brief send what this tick's budget allows */
+        void tick();
+        /** @brief pos is within the player's interest region */
+        bool covers(const bvmap::ChunkPos &pos) const {
+            return placed && inRange(pos);
+        }
+        /** @brief the player may move to pos in one step (anywhere before the first move) */
+        bool reaches(const bvmap::ChunkPos &pos) const {
+            return !placed || inRange(pos);
+        }
+        /** @brief resend chunk at pos whole (client lost track of it) */
+        void resync(const bvmap::ChunkPos &pos) {
+            if (sent.count(pos)>0)
+                stale.insert(pos);
+        }
+        /**
+        *   @brief stop tracking chunk at pos (client could not load it)
+        *
+        *   Nothing more is sent for it until the player moves
+        *   and the scan comes around to it again.
+        */
+        void forget(const bvmap::ChunkPos &pos) {
+            sent.erase(pos);
+            stale.erase(pos);
+        }
+        /** @brief interval at which tick() should run */
+        boost::posix_time::time_duration period() const {
+            return boost::posix_time::milliseconds(limits.tick_ms);
+        }
+
+        /** @brief chunks the client holds */
+        size_t loaded() const {return sent.size();}
+        /** @brief chunk data bytes sent */
+        u64 bytes() const {return bytesSent;}
+        /** @brief chunks sent whole */
+        u64 chunks() const {return chunksSent;}
+        /** @brief deltas sent */
+        u64 deltas() const {return deltasSent;}
+        /** @brief chunk unloads sent */
+        u64 unloaded() const {return unloadsSent;}
+    };
+
+}
+
+#endif // BV_CHUNKSTREAM_HPP_INCLUDED
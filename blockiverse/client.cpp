@@ -20,6 +20,109 @@
 
 namespace bvclient {
 
+    void clientRoot::dmc_ChunkLoad(bvnet::value_queue &vqueue) {
+        /*  in: int: entity the chunk belongs to
+        **      int: chunk x
+        **      int: chunk y
+        **      int: chunk z
+        **      int: version
+        **      blob: packed chunk (see bvmap::packChunk)
+        **
+        ** out: nothing
+        **
+        ** A chunk that cannot be unpacked is damaged at the
+        ** source (asking again would not help) so the server is
+        ** told to stop tracking it, or it would keep sending
+        ** deltas for a chunk we do not have.
+        */
+        bvnet::blob data=ctx.getarg<bvnet::blob>(); /* LIFO is chunk */
+        s64 version=ctx.getarg<s64>();
+        s64 cz=ctx.getarg<s64>();
+        s64 cy=ctx.getarg<s64>();
+        s64 cx=ctx.getarg<s64>();
+        s64 entity=ctx.getarg<s64>();
+        std::string key=chunkCache::key(entity,cx,cy,cz);
+        chunkPtr c(new Chunk);
+        try {
+            bvmap::unpackChunk(*c,data.data(),data.size());
+        } catch (bvmap::ChunkFormatError &e) {
+            BVLOG_WARN("clientRoot [" << this << "] chunk " << key
+                       << " version " << version << " dropped: " << e.what());
+            chunks.loaded.erase(key);
+            chunks.versions.erase(key);
+            if (account!=0) {
+                ctx.send_int(entity);
+                ctx.send_int(cx);
+                ctx.send_int(cy);
+                ctx.send_int(cz);
+                ctx.send_call(account,"ChunkDropped");
+            }
+            return;
+        }
+        chunks.loaded[key]=c;
+        chunks.versions[key]=version;
+    }
+
+    void clientRoot::dmc_ChunkDelta(bvnet::value_queue &vqueue) {
+        /*  in: int: entity the chunk belongs to
+        **      int: chunk x
+        **      int: chunk y
+        **      int: chunk z
+        **      int: version the delta applies to
+        **      int: version after applying it
+        **      blob: delta (see bvmap::encodeDelta)
+        **
+        ** out: nothing
+        **
+        ** A delta for a version we do not have means our copy is
+        ** wrong so it is dropped and the server asked to resend it.
+        */
+        bvnet::blob data=ctx.getarg<bvnet::blob>(); /* LIFO is delta */
+        s64 to=ctx.getarg<s64>();
+        s64 from=ctx.getarg<s64>();
+        s64 cz=ctx.getarg<s64>();
+        s64 cy=ctx.getarg<s64>();
+        s64 cx=ctx.getarg<s64>();
+        s64 entity=ctx.getarg<s64>();
+        std::string key=chunkCache::key(entity,cx,cy,cz);
+        chunkMap::iterator c=chunks.loaded.find(key);
+        if (c!=chunks.loaded.end() && chunks.versions[key]==from) {
+            try {
+                bvmap::applyDelta(*c->second,data.data(),data.size());
+                chunks.versions[key]=to;
+                return;
+            } catch (bvmap::ChunkFormatError &e) {
+                // fall through to a resync
+            }
+        }
+        chunks.loaded.erase(key);
+        chunks.versions.erase(key);
+        if (account!=0) {
+            ctx.send_int(entity);
+            ctx.send_int(cx);
+            ctx.send_int(cy);
+            ctx.send_int(cz);
+            ctx.send_call(account,"ChunkResync");
+        }
+    }
+
+    void clientRoot::dmc_ChunkUnload(bvnet::value_queue &vqueue) {
+        /*  in: int: entity the chunk belongs to
+        **      int: chunk x
+        **      int: chunk y
+        **      int: chunk z
+        **
+        ** out: nothing
+        */
+        s64 cz=ctx.getarg<s64>(); /* LIFO is z */
+        s64 cy=ctx.getarg<s64>();
+        s64 cx=ctx.getarg<s64>();
+        s64 entity=ctx.getarg<s64>();
+        std::string key=chunkCache::key(entity,cx,cy,cz);
+        chunks.loaded.erase(key);
+        chunks.versions.erase(key);
+    }
+
     /** @brief generate visible mesh for visible blocks
         Cenetered on 0,0,0 of loaded block cache looking
         in the direction of the specified viewer angle.
@@ -22,10 +22,12 @@
 #include "common.hpp"
 #include "protocol.hpp"
 #include "chunk.hpp"
+#include "chunkcodec.hpp"
 #include <inttypes.h>
 #include <string>
 #include <irrlicht.h>
 #include <map>
+#include <sstream>
 
 namespace bvclient {
 
@@ -41,6 +43,7 @@ namespace bvclient {
     typedef std::shared_ptr<Chunk> chunkPtr;
     typedef std::map<std::string,chunkPtr> chunkMap;
     typedef std::map<std::string,int> userMap;
+    typedef std::map<std::string,u32> versionMap;
     typedef std::map<uint16_t,ITexture*> texMap;
 
     class chunkCache {
@@ -49,27 +52,46 @@ namespace bvclient {
             Make me a proper class and put that enumed stuff into ctor
             to allow eventual user-adjustment of view range in client */
         enum ranges {
-            dist=16,
+            dist=bvmap::view_dist,
             range=1+2*dist,                 // [-dist,dist] chunks=1+2*dist
             cube_range=range*range*range    // total chunks in range in 3-space
         };
         /** @brief Chunks loaded in memory */
         chunkMap loaded;
+        /** @brief Server's version of each loaded chunk */
+        versionMap versions;
         /** @brief How many cells using each chunk
             Remove from loadedChunks and chunkUsers upon reaching 0 */
         userMap  users;
         /** @brief 3D chunk cell mapping
             Sized for 16-chunk (256-block) visible range */
         chunkPtr viewable[cube_range];
+
+        /** @brief key of a chunk in loaded */
+        static std::string key(s64 entity,s64 cx,s64 cy,s64 cz) {
+            std::ostringstream ss;
+            ss << entity << ':' << cx << ',' << cy << ',' << cz;
+            return ss.str();
+        }
     };
 
     class clientRoot : public bvnet::object {
     private:
+        chunkCache &chunks;
+        u32 account;    /**< @brief server account object (0 until logged in) */
     protected:
+        void dmc_ChunkLoad(bvnet::value_queue &vqueue);
+        void dmc_ChunkDelta(bvnet::value_queue &vqueue);
+        void dmc_ChunkUnload(bvnet::value_queue &vqueue);
     public:
-        clientRoot(bvnet::session &sess)
-            : bvnet::object(sess) {
+        clientRoot(bvnet::session &sess,chunkCache &cache)
+            : bvnet::object(sess),chunks(cache),account(0) {
+            register_dmc("ChunkLoad"    ,(bvnet::dmc)&clientRoot::dmc_ChunkLoad);
+            register_dmc("ChunkDelta"   ,(bvnet::dmc)&clientRoot::dmc_ChunkDelta);
+            register_dmc("ChunkUnload"  ,(bvnet::dmc)&clientRoot::dmc_ChunkUnload);
         }
+        /** @brief server account object to ask for resyncs (and report dropped chunks to) */
+        void setAccount(u32 acct) {account=acct;}
         virtual ~clientRoot() {
             LOCK_COUT
             cout << "clientRoot [" << this << "] gone (via session " << &ctx << ')' << endl;
@@ -101,6 +123,8 @@ namespace bvclient {
         }
 
         ISceneManager* getSceneManager() {return smgr;}
+        /** @brief chunks received from the server */
+        chunkCache &getChunks() {return chunks;}
 
         bool run() {return device->run();}
 
@@ -17,15 +17,62 @@
 **
 */
 #include "database.hpp"
+#include <deque>
 
 namespace bvdb {
 
+    namespace {
+        /** @brief interned SQL (a deque so texts never move) */
+        struct intern_table {
+            boost::mutex lock;
+            std::deque<string> text;
+            std::map<string,query_id> ids;
+        };
+        intern_table &interned() {
+            // constructed on first use: queries are interned
+            // during static initialization of other files
+            static intern_table table;
+            return table;
+        }
+    }
+
+    query_id intern(const string &sql) {
+        intern_table &t=interned();
+        boost::mutex::scoped_lock hold(t.lock);
+        std::map<string,query_id>::iterator known=t.ids.find(sql);
+        if (known!=t.ids.end())
+            return known->second;
+        query_id id=query_id(t.text.size());
+        t.text.push_back(sql);
+        t.ids[sql]=id;
+        return id;
+    }
+
+    const char *interned_sql(query_id id) {
+        intern_table &t=interned();
+        boost::mutex::scoped_lock hold(t.lock);
+        if (id>=t.text.size())
+            throw DBError("Unknown query id.");
+        return t.text[id].c_str();
+    }
+
+    query_id interned_count() {
+        intern_table &t=interned();
+        boost::mutex::scoped_lock hold(t.lock);
+        return query_id(t.text.size());
+    }
+
     string SQLiteDB::file;
+    db_tuning SQLiteDB::tuning;
+    boost::recursive_mutex SQLiteDB::writeLock;
+    boost::mutex SQLiteDB::statsLock;
+    busy_map SQLiteDB::busyCounts;
 
-    void init_db(string where) {
+    void init_db(string where,const db_tuning &tuning) {
         /**
         * @brief Creates database/tables for blockiverse
         * @param where pathname to database file
+        * @param tuning settings for every connection
         */
         bool sql3_safe=sqlite3_threadsafe();
         LOCK_COUT
@@ -35,7 +82,24 @@ namespace bvdb {
         if (!sql3_safe) {
             throw NotThreadable("SQLite3 compiled single-thread-only.");
         }
-        SQLiteDB::init(where);
+        // any case, as SQLite takes it
+        db_tuning settings=tuning;
+        string &sync=settings.synchronous;
+        for (auto &c : sync)
+            c=toupper((unsigned char)c);
+        if (sync!="OFF" && sync!="NORMAL" && sync!="FULL" && sync!="EXTRA"
+            && !(sync.size()==1 && sync[0]>='0' && sync[0]<='3')) {
+            throw DBError("synchronous must be OFF, NORMAL, FULL, EXTRA or 0-3.");
+        }
+        SQLiteDB::init(where,settings);
+        // journal mode is kept in the file so one connection sets it
+        SQLiteDB db;
+        db.runOnce(settings.wal?"PRAGMA journal_mode=WAL;":"PRAGMA journal_mode=DELETE;");
+        LOCK_COUT
+        cout << "[DB] journal " << (tuning.wal?"WAL":"rollback")
+             << ", synchronous " << sync << ", busy timeout " << tuning.busy_ms
+             << "ms, mmap " << tuning.mmap_size << " bytes" << endl;
+        UNLOCK_COUT
     }
 
 };
@@ -19,11 +19,21 @@
 #ifndef BV_DATABASE_HPP_INCLUDED
 #define BV_DATABASE_HPP_INCLUDED
 
+#include <cctype>
 #include <memory>
 #include <exception>
 #include <string>
 #include "common.hpp"
+#include "log.hpp"
 #include <boost/core/noncopyable.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+#include <type_traits>
 #include "sqlite/sqlite3.h"
 
 namespace bvdb {
@@ -34,7 +44,30 @@ std::ostream& operator<<(std::ostream &,const bvdb::dbValue &);
 
 namespace bvdb {
 
-    extern void init_db(string);
+    /** @brief settings applied to every connection (see init_db) */
+    struct db_tuning {
+        bool wal;               /**< @brief write-ahead log (readers never wait for writers) */
+        int busy_ms;            /**< @brief wait this long on a lock before SQLITE_BUSY */
+        string synchronous;     /**< @brief OFF, NORMAL, FULL, EXTRA or 0-3 (any case) */
+        s64 mmap_size;          /**< @brief bytes of the file to memory map (0 for none) */
+        int retry_first_us;     /**< @brief first backoff after SQLITE_BUSY */
+        int retry_max_us;       /**< @brief longest backoff (doubling up to it) */
+        int retry_deadline_ms;  /**< @brief stop retrying (DBTimeout) after this long */
+        db_tuning() : wal(true),busy_ms(5000),synchronous("NORMAL"),mmap_size(64<<20),
+                      retry_first_us(200),retry_max_us(100000),retry_deadline_ms(30000) {}
+    };
+
+    /** @brief SQLITE_BUSY for one statement (see SQLiteDB::busyStats) */
+    struct busy_stat {
+        u64 busy;               /**< @brief times it found the database busy */
+        u64 timeouts;           /**< @brief times retrying it gave up */
+        u64 waited_us;          /**< @brief time spent backing off */
+        busy_stat() : busy(0),timeouts(0),waited_us(0) {}
+    };
+    /** @brief busy_stat by SQL text */
+    typedef std::map<string,busy_stat> busy_map;
+
+    extern void init_db(string,const db_tuning &tuning=db_tuning());
 
     /** @brief Column type casting error */
     struct ColumnCastFailed : public std::runtime_error {
@@ -55,6 +88,7 @@ namespace bvdb {
         enum _flags {noop,release};
         [[noreturn]] static void busy_aware_throw(int code,const char *msg,_flags f=noop) {
             if (code==SQLITE_BUSY) {
+                if (f==release) sqlite3_free((void*)msg);
                 throw DBIsBusy();
             } else {
                 throw DBError(msg,f);
@@ -64,6 +98,10 @@ namespace bvdb {
             if (f==release) sqlite3_free((void*)msg);
         }
     };
+    /** @brief Database stayed busy past the retry deadline (see db_tuning) */
+    struct DBTimeout : public DBError {
+        DBTimeout(const char *msg) : DBError(msg) {}
+    };
 
     class dbValue : boost::noncopyable {
     public:
@@ -155,11 +193,54 @@ namespace bvdb {
         }
     };
 
+    /** @brief blob query parameter (the bytes are copied when bound) */
+    struct blob_ref {
+        const char *data;
+        size_t size;
+        blob_ref(const char *d,size_t n) : data(d),size(n) {}
+        blob_ref(const string &s) : data(s.data()),size(s.size()) {}
+    };
+
+    /** @brief process-wide number of an interned SQL text */
+    typedef unsigned query_id;
+    /**
+    *   @brief number of sql, the same for the same text
+    *   (ids count up from 0 and are never reused)
+    */
+    query_id intern(const string &sql);
+    /** @brief text interned as id (valid for the life of the process) */
+    const char *interned_sql(query_id id);
+    /** @brief ids interned so far (all below this) */
+    query_id interned_count();
+
+    /**
+    *   @brief SQL with the types of its parameters (?1..?n in
+    *   order) and of its result columns.
+    *
+    *   Params and Row are std::tuples of s64, int, double,
+    *   string or (Params only) blob_ref.  Binding and reading
+    *   through SQLiteDB's query members is then checked against
+    *   them at compile time (see queries.hpp).
+    *
+    *   The text is interned on construction so connections find
+    *   the compiled statement by id without touching the text.
+    */
+    template<typename Params,typename Row=std::tuple<> >
+    struct query {
+        typedef Params params;
+        typedef Row row;
+        query_id id;
+        const char *sql;
+        query(const string &text) : id(intern(text)),sql(interned_sql(id)) {}
+    };
+
     /** @brief keys are column names which yield the dbValue ptrs */
     typedef std::map<int,dbValue::ptr> rowResult;
     typedef std::vector<rowResult> Result;
-    /** @brief statement cache map type */
+    /** @brief statement cache map type (SQL not interned) */
     typedef std::map<string,sqlite3_stmt*> stmt_map;
+    /** @brief statement cache indexed by query_id */
+    typedef std::vector<sqlite3_stmt*> stmt_table;
 
     /**
      *  @brief Manager class for SQLite3 database and connections
@@ -171,112 +252,392 @@ namespace bvdb {
      *  statements on first use to prevent the overhead of subsequent
      *  compilations of SQL statements so long as class user utilizes
      *  binding semantics versus inline parameters.
+     *
+     *  Writes from all connections take turns: a connection
+     *  takes the process-wide writer's turn before its first
+     *  write (or BEGIN IMMEDIATE/EXCLUSIVE) and gives it back
+     *  once it is out of its transaction, so writers queue on a
+     *  mutex rather than fail busy on the database lock.  A
+     *  transaction must therefore begin and end on one thread.
+     *  Read-only connections never take the turn.
      */
     class SQLiteDB : private boost::noncopyable {
+    public:
+        enum access {read_write,read_only};
     private:
         static string file;
+        static db_tuning tuning;
+        /** @brief writer's turn (see class description) */
+        static boost::recursive_mutex writeLock;
         sqlite3 *db;
+        bool readOnly;
+        /** @brief this connection holds writeLock */
+        bool writing;
+        /** @brief spreads out backoffs of connections busy together */
+        std::minstd_rand jitter;
+
+        static boost::mutex statsLock;
+        static busy_map busyCounts;
+        /** @brief count a busy result of sql (waited_us backing off) */
+        static void noteBusy(const char *sql,u64 waited_us,bool timedOut) {
+            // long scripts (table setup) are known by how they start
+            string key(sql);
+            if (key.size()>120)
+                key.resize(120);
+            boost::mutex::scoped_lock hold(statsLock);
+            busy_stat &s=busyCounts[key];
+            if (timedOut) {
+                ++s.timeouts;
+            } else {
+                ++s.busy;
+                s.waited_us+=waited_us;
+            }
+        }
+
+        /**
+        *   @brief f() retried while it throws DBIsBusy
+        *
+        *   Waits between tries double from tuning.retry_first_us
+        *   up to tuning.retry_max_us, each cut by a random amount
+        *   of up to half so that connections busy at the same
+        *   time come back at different times.
+        *
+        *   @param sql what f runs (for the busy counters)
+        *   @throw DBTimeout still busy after tuning.retry_deadline_ms
+        */
+        template<typename F>
+        void retry(const char *sql,F f) {
+            using namespace boost::posix_time;
+            ptime start(not_a_date_time);
+            long delay=std::max(1,tuning.retry_first_us);
+            for (;;) {
+                try {
+                    f();
+                    return;
+                } catch (DBIsBusy &busy) {
+                    // backed off below
+                }
+                ptime now=microsec_clock::universal_time();
+                if (start.is_not_a_date_time())
+                    start=now;
+                if ((now-start).total_milliseconds()>=tuning.retry_deadline_ms) {
+                    noteBusy(sql,0,true);
+                    BVLOG_WARN("[DB] busy for " << tuning.retry_deadline_ms << "ms, gave up: " << sql);
+                    throw DBTimeout("SQLite stayed busy past the retry deadline.");
+                }
+                long wait=delay-long(jitter()%(delay/2+1));
+                noteBusy(sql,wait,false);
+                boost::this_thread::sleep(microseconds(wait));
+                delay=std::min(delay*2,long(std::max(1,tuning.retry_max_us)));
+            }
+        }
+
+        /** @brief holds the writer's turn for a statement and until its transaction ends */
+        class write_turn : private boost::noncopyable {
+            SQLiteDB &conn;
+        public:
+            write_turn(SQLiteDB &c,bool writes) : conn(c) {
+                if (writes && !conn.writing && !conn.readOnly) {
+                    writeLock.lock();
+                    conn.writing=true;
+                }
+            }
+            ~write_turn() {
+                if (conn.writing && sqlite3_get_autocommit(conn.db)) {
+                    conn.writing=false;
+                    writeLock.unlock();
+                }
+            }
+        };
+        /** @brief sql starts with upper case prefix (ignoring case and leading space) */
+        static bool startsWith(const char *sql,const char *prefix) {
+            while (isspace((unsigned char)*sql))
+                ++sql;
+            for (;*prefix;++sql,++prefix)
+                if (toupper((unsigned char)*sql)!=*prefix)
+                    return false;
+            return true;
+        }
+        /** @brief stmt needs the writer's turn */
+        static bool writes(sqlite3_stmt *stmt) {
+            if (!sqlite3_stmt_readonly(stmt))
+                return true;
+            // transaction control is "read only" but these lock at once
+            const char *sql=sqlite3_sql(stmt);
+            return startsWith(sql,"BEGIN IMMEDIATE") || startsWith(sql,"BEGIN EXCLUSIVE");
+        }
+        /** @brief run sql with no results, no caching and no writer's turn */
+        void exec(const string &sql) {
+            retry(sql.c_str(),[&]() {
+                char *err=NULL;
+                int rc=sqlite3_exec(db,sql.c_str(),NULL,NULL,&err);
+                if (rc) {
+                    DBError::busy_aware_throw(rc,err,DBError::release);
+                }
+            });
+        }
         /** @brief optimizer cache of statements for faster operations
         *   These will be appropriately released in dtor */
         stmt_map stmtCache;
+        /** @brief as stmtCache for interned SQL (NULL where not compiled yet) */
+        stmt_table stmtById;
+        /** @brief compile sql (throws on failure, NULL if sql is empty) */
+        sqlite3_stmt *compile(const char *sql) {
+            sqlite3_stmt *target=NULL;
+            int rc=sqlite3_prepare_v2(db,sql,-1,&target,NULL);
+            if (rc) {
+                DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
+            }
+            BVLOG_DEBUG("[DB] Statement compiled: "
+                      << target << ": " << sql);
+            return target;
+        }
     public:
-        static void init(const string path) {
-            if (file.size()==0)
+        static void init(const string path,const db_tuning &settings) {
+            if (file.size()==0) {
                 file=path;
-            else
+                tuning=settings;
+            } else {
                 throw DBError("Multiple attempts to set database file.");
+            }
         }
-        SQLiteDB() {
+        explicit SQLiteDB(access mode=read_write) {
             db=NULL;
+            readOnly=(mode==read_only);
+            writing=false;
+            jitter.seed(unsigned(size_t(this))^unsigned(time(NULL)));
             if (file.size()==0) {
                 throw DBError("Database file not set.");
             }
-            int rc=sqlite3_open(file.c_str(),&db);
+            int flags=readOnly?SQLITE_OPEN_READONLY:(SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE);
+            int rc=sqlite3_open_v2(file.c_str(),&db,flags,NULL);
             if (rc) {
-                DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
+                string msg=sqlite3_errmsg(db);
+                sqlite3_close(db);
+                db=NULL;
+                DBError::busy_aware_throw(rc,msg.c_str());
             }
-            runOnce("PRAGMA foreign_keys=ON;");
+            sqlite3_busy_timeout(db,tuning.busy_ms);
+            exec("PRAGMA foreign_keys=ON;");
+            exec("PRAGMA synchronous="+tuning.synchronous+";");
+            exec("PRAGMA mmap_size="+std::to_string(tuning.mmap_size)+";");
         }
         virtual ~SQLiteDB() {
             for (auto&& i : stmtCache) {
-                LOCK_COUT
-                cout << "[DB] delete cached statement " << i.second << endl;
-                UNLOCK_COUT
+                BVLOG_DEBUG("[DB] delete cached statement " << i.second);
                 sqlite3_finalize(i.second);
                 i.second=NULL;
             }
+            for (auto&& i : stmtById) {
+                sqlite3_finalize(i);
+                i=NULL;
+            }
             if (db!=NULL) {
+                // closing rolls back any transaction left open
                 sqlite3_close(db);
                 db=NULL;
             }
+            if (writing) {
+                writing=false;
+                writeLock.unlock();
+            }
         }
 
+        /** @brief connection can only read */
+        bool isReadOnly() const {return readOnly;}
+        /** @brief a transaction is open on this connection */
+        bool inTransaction() const {return !sqlite3_get_autocommit(db);}
+
         typedef std::shared_ptr<Result> query_result;
         template<typename T>
         T get_result(query_result rslt,int row,int col) {return (T)(*(((*rslt)[row])[col]));}
 
-        query_result run(sqlite3_stmt *stmt) {
-            query_result data(new Result);
-            int rc;
-            do {
+        /**
+        *   @brief steps a statement reading columns where SQLite
+        *   keeps them.
+        *
+        *   Nothing is copied or allocated per row: text and blob
+        *   columns are read in place and stay valid until the
+        *   next call to next().  NULL reads as 0 or empty (check
+        *   with isNull()).  The statement is reset when the
+        *   cursor goes away so it can be run again.
+        *
+        *       SQLiteDB::cursor rows(db,stmt);
+        *       while (rows.next())
+        *           total+=rows.getInt(0);
+        */
+        class cursor : private boost::noncopyable {
+            SQLiteDB &conn;
+            sqlite3_stmt *stmt;
+            write_turn turn;
+            bool patient;
+            bool done;
+            size_t rows;
+
+            void step(int &rc) {
                 rc=sqlite3_step(stmt);
+                if (rc==SQLITE_BUSY) {
+                    sqlite3_reset(stmt);
+                    throw DBIsBusy();
+                }
+            }
+        public:
+            /**
+            *   @param retryBusy retry the first step with backoff
+            *   while the database is busy (as loop_run does)
+            */
+            cursor(SQLiteDB &c,sqlite3_stmt *s,bool retryBusy=true)
+                : conn(c),stmt(s),turn(c,writes(s)),patient(retryBusy),done(false),rows(0) {}
+            ~cursor() {
+                sqlite3_reset(stmt);
+            }
+
+            /**
+            *   @brief advance to the next row
+            *   @return false when there are no more
+            *   @throw DBError (DBIsBusy if busy after the first row)
+            */
+            bool next() {
+                if (done)
+                    return false;
+                int rc;
+                if (rows==0 && patient)
+                    conn.retry(sqlite3_sql(stmt),[&]() {step(rc);});
+                else
+                    step(rc);
                 if (rc==SQLITE_ROW) {
-                    data->resize(data->size()+1);
-                    rowResult &cur=data->back();
-                    int nrows=sqlite3_column_count(stmt);
-                    for (int i=0;i<nrows;++i) {
-                        s64 int_val;
-                        double double_val;
-                        const char *data_val;
-                        int data_len;
-                        switch (sqlite3_column_type(stmt,i)) {
-                        case SQLITE_NULL:
-                            cur[i]=dbValue::ptr(new dbValue);
-                            break;
-                        case SQLITE_INTEGER:
-                            int_val=sqlite3_column_int(stmt,i);
-                            cur[i]=dbValue::ptr(new dbValue(int_val));
-                            break;
-                        case SQLITE_FLOAT:
-                            double_val=sqlite3_column_double(stmt,i);
-                            cur[i]=dbValue::ptr(new dbValue(double_val));
-                            break;
-                        case SQLITE_TEXT:
-                            data_val=(const char *)sqlite3_column_text(stmt,i);
-                            cur[i]=dbValue::ptr(new dbValue(data_val));
-                            break;
-                        case SQLITE_BLOB:
-                            data_val=(const char *)sqlite3_column_blob(stmt,i);
-                            data_len=sqlite3_column_bytes(stmt,i);
-                            cur[i]=dbValue::ptr(new dbValue(data_val,data_len));
-                            break;
-                        }
+                    ++rows;
+                    return true;
+                }
+                done=true;
+                if (rc!=SQLITE_DONE)
+                    DBError::busy_aware_throw(rc,sqlite3_errmsg(conn.db));
+                return false;
+            }
+            /** @brief rows stepped over so far */
+            size_t count() const {return rows;}
+
+            int columns() const {return sqlite3_column_count(stmt);}
+            /** @brief SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL */
+            int type(int col) const {return sqlite3_column_type(stmt,col);}
+            bool isNull(int col) const {return type(col)==SQLITE_NULL;}
+            s64 getInt(int col) const {return sqlite3_column_int64(stmt,col);}
+            double getReal(int col) const {return sqlite3_column_double(stmt,col);}
+            /** @brief text or blob of col in place (NULL for none) */
+            const char *bytes(int col,size_t &len) const {
+                const char *p=(type(col)==SQLITE_BLOB)
+                    ?(const char*)sqlite3_column_blob(stmt,col)
+                    :(const char*)sqlite3_column_text(stmt,col);
+                // after the pointer: the length is of the form fetched
+                len=sqlite3_column_bytes(stmt,col);
+                return p;
+            }
+            string getString(int col) const {
+                size_t len;
+                const char *p=bytes(col,len);
+                return (p==NULL)?string():string(p,len);
+            }
+
+            void read(int col,s64 &v) const {v=getInt(col);}
+            void read(int col,int &v) const {v=sqlite3_column_int(stmt,col);}
+            void read(int col,double &v) const {v=getReal(col);}
+            void read(int col,string &v) const {
+                size_t len;
+                const char *p=bytes(col,len);
+                if (p==NULL)
+                    v.clear();
+                else
+                    v.assign(p,len);
+            }
+            /** @brief col as T (s64, int, double or string) */
+            template<typename T>
+            T get(int col) const {
+                T v;
+                read(col,v);
+                return v;
+            }
+
+            /** @brief next() reading the whole row, column i into element i */
+            template<typename... T>
+            bool next(std::tuple<T...> &row) {
+                if (!next())
+                    return false;
+                readFrom<0>(row);
+                return true;
+            }
+        private:
+            template<size_t I,typename... T>
+            typename std::enable_if<(I==sizeof...(T))>::type readFrom(std::tuple<T...>&) const {}
+            template<size_t I,typename... T>
+            typename std::enable_if<(I<sizeof...(T))>::type readFrom(std::tuple<T...> &row) const {
+                read(int(I),std::get<I>(row));
+                readFrom<I+1>(row);
+            }
+        };
+
+        /** @brief run stmt to completion collecting every row (see cursor) */
+        query_result run(sqlite3_stmt *stmt) {
+            query_result data(new Result);
+            cursor rows(*this,stmt,false);
+            while (rows.next()) {
+                data->resize(data->size()+1);
+                rowResult &cur=data->back();
+                int ncols=rows.columns();
+                for (int i=0;i<ncols;++i) {
+                    size_t len;
+                    const char *p;
+                    switch (rows.type(i)) {
+                    case SQLITE_NULL:
+                        cur[i]=dbValue::ptr(new dbValue);
+                        break;
+                    case SQLITE_INTEGER:
+                        cur[i]=dbValue::ptr(new dbValue(rows.getInt(i)));
+                        break;
+                    case SQLITE_FLOAT:
+                        cur[i]=dbValue::ptr(new dbValue(rows.getReal(i)));
+                        break;
+                    case SQLITE_TEXT:
+                        p=rows.bytes(i,len);
+                        cur[i]=dbValue::ptr(new dbValue(p));
+                        break;
+                    case SQLITE_BLOB:
+                        p=rows.bytes(i,len);
+                        cur[i]=dbValue::ptr(new dbValue(p,len));
+                        break;
                     }
                 }
-            } while (rc==SQLITE_ROW);
-            if (rc!=SQLITE_DONE) {
-                DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
             }
-            LOCK_COUT
-            cout << "[DB] " << stmt << ": " << data->size() << " rows returned." << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("[DB] " << stmt << ": " << data->size() << " rows returned.");
             return data;
         }
 
+        /**
+        *   @brief run() retrying with backoff while the database is busy
+        *   @throw DBTimeout if it stays busy (see db_tuning)
+        */
         query_result loop_run(sqlite3_stmt *stmt) {
-            bool try_again;
             query_result rc;
-            do {
-                try_again=false;
+            retry(sqlite3_sql(stmt),[&]() {
                 try {
                     rc=run(stmt);
                 } catch (DBIsBusy &busy) {
-                    try_again=true;
+                    // start over from the first row (bindings are kept)
+                    sqlite3_reset(stmt);
+                    throw;
                 }
-            } while (try_again);
+            });
             return rc;
         }
 
+        /** @brief busy counters of all connections so far */
+        static busy_map busyStats() {
+            boost::mutex::scoped_lock hold(statsLock);
+            return busyCounts;
+        }
+
+
+        /** @brief rows changed by the last statement run */
+        int changes() {return sqlite3_changes(db);}
 
         typedef sqlite3_stmt *statement;
         void bind(statement s,int idx,const string &val) {
@@ -285,9 +646,7 @@ namespace bvdb {
             if (rc) {
                 DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
             }
-            LOCK_COUT
-            cout << "[DB] " << s << ": " << "?" << idx << " = \"" << val << '"' << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("[DB] " << s << ": " << "?" << idx << " = \"" << val << '"');
         }
         void bind(statement s,int idx,const char *val,int len) {
             /** @brief bind argument with binary data (blob) */
@@ -295,39 +654,35 @@ namespace bvdb {
             if (rc) {
                 DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
             }
-            LOCK_COUT
-            cout << "[DB] " << s << ": " << "?" << idx << " = (blob of size " << len << ")" << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("[DB] " << s << ": " << "?" << idx << " = (blob of size " << len << ")");
+        }
+        void bind(statement s,int idx,const blob_ref &val) {
+            /** @brief bind argument with binary data (blob) */
+            bind(s,idx,val.data,int(val.size));
         }
-        void bind(statement s,int idx,s64 &val) {
+        void bind(statement s,int idx,s64 val) {
             /** @brief bind argument with an int64 */
             int rc=sqlite3_bind_int64(s,idx,val);
             if (rc) {
                 DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
             }
-            LOCK_COUT
-            cout << "[DB] " << s << ": " << "?" << idx << " = " << val << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("[DB] " << s << ": " << "?" << idx << " = " << val);
         }
-        void bind(statement s,int idx,int &val) {
+        void bind(statement s,int idx,int val) {
             /** @brief bind argument with an integer */
             int rc=sqlite3_bind_int(s,idx,val);
             if (rc) {
                 DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
             }
-            LOCK_COUT
-            cout << "[DB] " << s << ": " << "?" << idx << " = " << val << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("[DB] " << s << ": " << "?" << idx << " = " << val);
         }
-        void bind(statement s,int idx,double &val) {
+        void bind(statement s,int idx,double val) {
             /** @brief bind argument with a double */
             int rc=sqlite3_bind_double(s,idx,val);
             if (rc) {
                 DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
             }
-            LOCK_COUT
-            cout << "[DB] " << s << ": " << "?" << idx << " = " << val << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("[DB] " << s << ": " << "?" << idx << " = " << val);
         }
         void bind_null(statement s,int idx) {
             /** @brief bind argument with nothing (null) */
@@ -335,9 +690,7 @@ namespace bvdb {
             if (rc) {
                 DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
             }
-            LOCK_COUT
-            cout << "[DB] " << s << ": " << "?" << idx << " = (null)" << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("[DB] " << s << ": " << "?" << idx << " = (null)");
         }
         sqlite3_stmt* prepare(string sql) {
             /** @brief compile sql to prepared statement
@@ -352,30 +705,114 @@ namespace bvdb {
                 sqlite3_stmt *stmt=lookup->second;
                 sqlite3_reset(stmt);
                 sqlite3_clear_bindings(stmt);
-                LOCK_COUT
-                cout << "[DB] Statement (cached): "
-                          << stmt << ": " << sql << endl;
-                UNLOCK_COUT
+                BVLOG_DEBUG("[DB] Statement (cached): "
+                          << stmt << ": " << sql);
                 return stmt;
             } else {
-                sqlite3_stmt *target=NULL;
-                int rc=sqlite3_prepare_v2(db,sql.c_str(),sql.size(),&target,NULL);
-                if (rc) {
-                    DBError::busy_aware_throw(rc,sqlite3_errmsg(db));
-                } else {
-                    if (target!=NULL) {
-                        // only cache if not not NULL
-                        stmtCache[sql]=target;
-                    }
-                    LOCK_COUT
-                    cout << "[DB] Statement compiled: "
-                              << target << ": " << sql << endl;
-                    UNLOCK_COUT
-                    return target;
+                sqlite3_stmt *target=compile(sql.c_str());
+                if (target!=NULL) {
+                    // only cache if not not NULL
+                    stmtCache[sql]=target;
+                }
+                return target;
+            }
+        }
+        /**
+        *   @brief as prepare(string) for interned SQL, found by
+        *   index rather than by text
+        */
+        sqlite3_stmt* prepare(query_id id) {
+            if (id>=stmtById.size())
+                stmtById.resize(interned_count(),NULL);
+            sqlite3_stmt *&stmt=stmtById[id];
+            if (stmt!=NULL) {
+                sqlite3_reset(stmt);
+                sqlite3_clear_bindings(stmt);
+                return stmt;
+            }
+            stmt=compile(interned_sql(id));
+            return stmt;
+        }
+        /**
+        *   @brief compile every interned statement not compiled yet
+        *   so that later prepares on this connection only reset
+        *
+        *   SQL that does not compile (yet) is skipped; it is tried
+        *   again when first prepared.
+        *   @return statements compiled
+        */
+        size_t warm() {
+            query_id count=interned_count();
+            stmtById.resize(count,NULL);
+            size_t n=0;
+            for (query_id id=0;id<count;++id) {
+                if (stmtById[id]!=NULL)
+                    continue;
+                try {
+                    stmtById[id]=compile(interned_sql(id));
+                    ++n;
+                } catch (DBError &e) {
+                    BVLOG_DEBUG("[DB] warm skipped " << interned_sql(id) << ": " << e.what());
                 }
             }
+            BVLOG_DEBUG("[DB] " << this << " warmed " << n << " statement(s)");
+            return n;
         }
 
+    private:
+        template<size_t I,typename... T>
+        typename std::enable_if<(I==sizeof...(T))>::type bindFrom(statement,const std::tuple<T...>&) {}
+        template<size_t I,typename... T>
+        typename std::enable_if<(I<sizeof...(T))>::type bindFrom(statement s,const std::tuple<T...> &args) {
+            bind(s,int(I)+1,std::get<I>(args));
+            bindFrom<I+1>(s,args);
+        }
+    public:
+        /**
+        *   @brief prepare q and bind args to its parameters
+        *   (how many and their types checked at compile time)
+        */
+        template<typename P,typename R,typename... A>
+        statement prepare(const query<P,R> &q,const A&... args) {
+            static_assert(sizeof...(A)==std::tuple_size<P>::value,
+                          "wrong number of arguments for query");
+            statement s=prepare(q.id);
+            bindFrom<0>(s,P(args...));
+            return s;
+        }
+        /**
+        *   @brief run q with args for its effect
+        *   @return rows changed
+        */
+        template<typename P,typename R,typename... A>
+        int perform(const query<P,R> &q,const A&... args) {
+            cursor rows(*this,prepare(q,args...));
+            while (rows.next()) {}
+            return changes();
+        }
+        /**
+        *   @brief first row of q with args
+        *   @return false if there is none (row left alone)
+        */
+        template<typename P,typename R,typename... A>
+        bool fetch(const query<P,R> &q,R &row,const A&... args) {
+            cursor rows(*this,prepare(q,args...));
+            return rows.next(row);
+        }
+        /**
+        *   @brief f(const R &row) for every row of q with args
+        *   @return rows
+        */
+        template<typename P,typename R,typename F,typename... A>
+        size_t each(const query<P,R> &q,F f,const A&... args) {
+            cursor rows(*this,prepare(q,args...));
+            R row;
+            while (rows.next(row))
+                f(const_cast<const R&>(row));
+            return rows.count();
+        }
+
+
         void runOnce(const string sql) {
             /**
             *   @brief Run SQL commend once
@@ -388,28 +825,17 @@ namespace bvdb {
             *
             *   @param sql SQL statement to execute
             *   @throw DBError should execution fail
+            *   (DBTimeout if the database stays busy)
             */
-            LOCK_COUT
             if (sql.size()>180) {
-                cout << "[DB] runOnce: " << sql.substr(0,177) << "..." << endl;
+                BVLOG_DEBUG("[DB] runOnce: " << sql.substr(0,177) << "...");
             } else {
-                cout << "[DB] runOnce: " << sql << endl;
+                BVLOG_DEBUG("[DB] runOnce: " << sql);
             }
-            UNLOCK_COUT
 
-            char *err=NULL;
-            bool again;
-            do {
-                try {
-                    again=false;
-                    int rc=sqlite3_exec(db,sql.c_str(),NULL,NULL,&err);
-                    if (rc) {
-                        DBError::busy_aware_throw(rc,err,DBError::release);
-                    }
-                } catch (DBIsBusy &e) {
-                    again=true;
-                }
-            } while (again);
+            // may hold several statements so it is taken to write
+            write_turn turn(*this,true);
+            exec(sql);
         }
     };
 
@@ -0,0 +1,187 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file dbpool.cpp
+**
+**  Database connections shared by the sessions
+**
+*/
+#include "dbpool.hpp"
+#include <algorithm>
+
+namespace bvdb {
+
+    namespace {
+        /** @brief health check (reads nothing, takes no writer's turn) */
+        const query<std::tuple<>,std::tuple<int> > ping={"SELECT 1"};
+    }
+
+    SQLitePool::SQLitePool(size_t max,boost::posix_time::time_duration timeout,boost::posix_time::time_duration idleCheck)
+        : open(0),maxOpen(std::max(max,size_t(1))),wait(timeout),check(idleCheck),
+          opened(0),reused(0),waited(0),timeouts(0),missed(0),discarded(0) {
+    }
+
+    SQLitePool::~SQLitePool() {
+        boost::mutex::scoped_lock hold(lock);
+        if (open>idle.size())
+            BVLOG_WARN("[DB] pool closed with " << (open-idle.size()) << " connection(s) still lent");
+        for (auto &c : idle)
+            delete c.conn;
+        idle.clear();
+    }
+
+    SQLiteDB *SQLitePool::connect() {
+        SQLiteDB *c=new SQLiteDB;
+        try {
+            c->warm();
+            BVLOG_DEBUG("[DB] pool opened connection " << c);
+        } catch (...) {
+            delete c;
+            throw;
+        }
+        return c;
+    }
+
+    bool SQLitePool::healthy(SQLiteDB &c) {
+        try {
+            std::tuple<int> one;
+            return !c.inTransaction() && c.fetch(ping,one) && std::get<0>(one)==1;
+        } catch (std::exception &e) {
+            BVLOG_WARN("[DB] pooled connection " << &c << " failed its check: " << e.what());
+            return false;
+        }
+    }
+
+    SQLitePool::lease SQLitePool::obtain(bool block) {
+        boost::mutex::scoped_lock hold(lock);
+        boost::system_time until=boost::get_system_time()+wait;
+        bool counted=false;
+        for (;;) {
+            while (!idle.empty()) {
+                idle_conn c=idle.back();
+                idle.pop_back();
+                if (now()-c.since<check) {
+                    ++reused;
+                    return lease(*this,c.conn);
+                }
+                hold.unlock();
+                bool ok=healthy(*c.conn);
+                if (!ok)
+                    delete c.conn;
+                hold.lock();
+                if (ok) {
+                    ++reused;
+                    return lease(*this,c.conn);
+                }
+                --open;
+                ++discarded;
+            }
+            if (open<maxOpen) {
+                // the slot is taken before opening so others wait for it
+                ++open;
+                SQLiteDB *c;
+                hold.unlock();
+                try {
+                    c=connect();
+                } catch (...) {
+                    hold.lock();
+                    --open;
+                    freed.notify_one();
+                    throw;
+                }
+                hold.lock();
+                ++opened;
+                return lease(*this,c);
+            }
+            if (!block) {
+                ++missed;
+                return lease();
+            }
+            if (!counted) {
+                ++waited;
+                counted=true;
+            }
+            if (!freed.timed_wait(hold,until) && idle.empty() && open>=maxOpen) {
+                ++timeouts;
+                BVLOG_WARN("[DB] no pooled connection came free in "
+                           << wait.total_milliseconds() << "ms (" << open << " open)");
+                throw DBTimeout("No database connection came free in time.");
+            }
+        }
+    }
+
+    void SQLitePool::giveBack(SQLiteDB *c) {
+        bool ok=true;
+        if (c->inTransaction()) {
+            // left behind by work that failed halfway
+            try {
+                c->runOnce("ROLLBACK");
+            } catch (std::exception &e) {
+                BVLOG_WARN("[DB] pooled connection " << c << " rollback failed: " << e.what());
+            }
+            ok=!c->inTransaction();
+        }
+        if (!ok)
+            delete c;
+        boost::mutex::scoped_lock hold(lock);
+        if (ok) {
+            idle_conn back={c,now()};
+            idle.push_back(back);
+        } else {
+            --open;
+            ++discarded;
+        }
+        freed.notify_one();
+    }
+
+    size_t SQLitePool::size() {
+        boost::mutex::scoped_lock hold(lock);
+        return open;
+    }
+
+    size_t SQLitePool::available() {
+        boost::mutex::scoped_lock hold(lock);
+        return idle.size()+(maxOpen-open);
+    }
+
+    u64 SQLitePool::openedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return opened;
+    }
+
+    u64 SQLitePool::reusedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return reused;
+    }
+
+    u64 SQLitePool::waitedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return waited;
+    }
+
+    u64 SQLitePool::timeoutCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return timeouts;
+    }
+
+    u64 SQLitePool::missedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return missed;
+    }
+
+    u64 SQLitePool::discardedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return discarded;
+    }
+
+}
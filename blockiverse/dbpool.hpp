@@ -0,0 +1,155 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file dbpool.hpp
+**
+**  Database connections shared by the sessions
+**
+*/
+#ifndef BV_DBPOOL_HPP_INCLUDED
+#define BV_DBPOOL_HPP_INCLUDED
+
+#include "common.hpp"
+#include "database.hpp"
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace bvdb {
+
+    /**
+    *   @brief a bounded set of read/write connections lent out
+    *   for as long as a piece of work needs one.
+    *
+    *   Connections are opened when none is free (up to the
+    *   maximum) and kept afterwards, each with every interned
+    *   statement already compiled (SQLiteDB::warm()), so a
+    *   session that borrows one pays neither for opening the
+    *   file nor for compiling its queries.  When all of them
+    *   are out acquire() waits for one to come back.
+    *
+    *   A connection returned inside a transaction is rolled
+    *   back, and dropped if that fails.  One that sat unused
+    *   longer than the check interval runs a trivial query
+    *   before it is lent again and is replaced if that fails.
+    *
+    *   Idle connections are lent most recently returned first.
+    *   All members may be called from any thread; a lease must
+    *   be used and given back on one thread (see SQLiteDB).
+    */
+    class SQLitePool : private boost::noncopyable {
+    public:
+        /** @brief a borrowed connection, returned when the lease ends */
+        class lease {
+            SQLitePool *pool;
+            SQLiteDB *conn;
+        public:
+            lease() : pool(NULL),conn(NULL) {}
+            lease(SQLitePool &p,SQLiteDB *c) : pool(&p),conn(c) {}
+            lease(lease &&o) : pool(o.pool),conn(o.conn) {o.conn=NULL;}
+            lease &operator=(lease &&o) {
+                if (this!=&o) {
+                    release();
+                    pool=o.pool;
+                    conn=o.conn;
+                    o.conn=NULL;
+                }
+                return *this;
+            }
+            lease(const lease&)=delete;
+            lease &operator=(const lease&)=delete;
+            ~lease() {release();}
+
+            SQLiteDB &operator*() const {return *conn;}
+            SQLiteDB *operator->() const {return conn;}
+            /** @brief holds a connection */
+            explicit operator bool() const {return conn!=NULL;}
+            /** @brief give the connection back now */
+            void release() {
+                if (conn!=NULL)
+                    pool->giveBack(conn);
+                conn=NULL;
+            }
+        };
+
+    private:
+        struct idle_conn {
+            SQLiteDB *conn;
+            boost::posix_time::ptime since;     /**< @brief returned at */
+        };
+
+        boost::mutex lock;
+        boost::condition_variable freed;       /**< @brief a connection came back or closed */
+        std::vector<idle_conn> idle;            /**< @brief most recently returned last */
+        size_t open;                /**< @brief lent, idle or being opened */
+        size_t maxOpen;
+        boost::posix_time::time_duration wait;
+        boost::posix_time::time_duration check;
+
+        u64 opened;
+        u64 reused;
+        u64 waited;                 /**< @brief acquires that found none free */
+        u64 timeouts;
+        u64 missed;                 /**< @brief tryAcquire() calls that found none free */
+        u64 discarded;              /**< @brief connections closed as unhealthy */
+
+        static boost::posix_time::ptime now() {
+            return boost::posix_time::microsec_clock::universal_time();
+        }
+        /** @brief a new connection with its statements compiled */
+        SQLiteDB *connect();
+        /** @brief c still answers */
+        static bool healthy(SQLiteDB &c);
+        void giveBack(SQLiteDB *c);
+        /** @brief acquire() that gives up at once if block is false */
+        lease obtain(bool block);
+    public:
+        /**
+        *   @param max connections open at most
+        *   @param timeout acquire() gives up after waiting this long
+        *   @param idleCheck connections idle longer are checked before reuse
+        */
+        explicit SQLitePool(size_t max=16,
+                            boost::posix_time::time_duration timeout=boost::posix_time::seconds(5),
+                            boost::posix_time::time_duration idleCheck=boost::posix_time::seconds(60));
+        /** @brief closes the connections (all leases must have ended) */
+        ~SQLitePool();
+
+        /**
+        *   @brief borrow a connection
+        *   @throw DBTimeout none came free in time
+        *   @throw DBError a new connection could not be opened
+        */
+        lease acquire() {return obtain(true);}
+        /**
+        *   @brief borrow a connection if one can be had without waiting
+        *   @return an empty lease if all are lent out
+        *   @throw DBError a new connection could not be opened
+        */
+        lease tryAcquire() {return obtain(false);}
+
+        /** @brief open connections (lent or idle) */
+        size_t size();
+        /** @brief connections that can be lent without waiting */
+        size_t available();
+        u64 openedCount();
+        u64 reusedCount();
+        u64 waitedCount();
+        u64 timeoutCount();
+        u64 missedCount();
+        u64 discardedCount();
+    };
+
+}
+
+#endif // BV_DBPOOL_HPP_INCLUDED
@@ -0,0 +1,323 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file dbwriter.cpp
+**
+**  World saves on a thread of their own
+**
+*/
+#include "dbwriter.hpp"
+#include <algorithm>
+#include <boost/bind.hpp>
+
+namespace bv {
+
+    using bvmap::ChunkPos;
+
+    namespace {
+        /** @brief failed batches in a row before writes are tried one by one */
+        const unsigned max_attempts=3;
+
+        void rollback(bvdb::SQLiteDB &db) {
+            try {
+                db.runOnce("ROLLBACK");
+            } catch (std::exception &ignored) {
+                // failed statements may already have ended it
+            }
+        }
+    }
+
+    DBWriter::DBWriter(bvmap::codec_id packing,boost::posix_time::time_duration interval,size_t max)
+        : worker(NULL),db(NULL),store(NULL),stopping(false),stopped(false),
+          codec(packing),linger(interval),batchMax(std::max(max,size_t(1))),
+          lastSeq(0),doneSeq(0),flushWaiters(0),
+          submitted(0),coalesced(0),batches(0),failures(0),dropped(0),keptRounds(0) {
+    }
+
+    DBWriter::~DBWriter() {
+        stop();
+    }
+
+    void DBWriter::start() {
+        boost::mutex::scoped_lock hold(lock);
+        if (worker!=NULL)
+            return;
+        db=new bvdb::SQLiteDB;
+        store=new bvmap::ChunkStore(*db,codec);
+        stopping=false;
+        stopped=false;
+        keptRounds=0;
+        worker=new boost::thread(boost::bind(&DBWriter::run,this));
+    }
+
+    void DBWriter::stop() {
+        boost::thread *ending;
+        {
+            boost::mutex::scoped_lock hold(lock);
+            if (worker==NULL)
+                return;
+            stopping=true;
+            stopped=true;
+            wake.notify_all();
+            ending=worker;
+        }
+        ending->join();
+        boost::mutex::scoped_lock hold(lock);
+        delete ending;
+        delete store;
+        delete db;
+        worker=NULL;
+        store=NULL;
+        db=NULL;
+        if (waiting()>0)
+            BVLOG_WARN("[DB] writer stopped with " << waiting() << " write(s) unsaved");
+        done.notify_all();
+    }
+
+    void DBWriter::put(const string &key,const write_op &op,bool keep) {
+        boost::mutex::scoped_lock hold(lock);
+        if (stopped)
+            throw DBWriterStopped("Database writer is stopped.");
+        queued_op &q=ops[key];
+        if (q.op)
+            ++coalesced;
+        q.seq=++lastSeq;
+        q.op=op;
+        q.keep=keep;
+        ++submitted;
+        if (waiting()>=batchMax)
+            wake.notify_one();
+    }
+
+    void DBWriter::saveChunk(const ChunkPos &pos,const bvmap::Chunk &c) {
+        string data;
+        c.serialize(data);
+        boost::mutex::scoped_lock hold(lock);
+        if (stopped)
+            throw DBWriterStopped("Database writer is stopped.");
+        string &q=chunks[pos];
+        if (!q.empty())
+            ++coalesced;
+        q.swap(data);
+        ++lastSeq;
+        ++submitted;
+        if (waiting()>=batchMax)
+            wake.notify_one();
+    }
+
+    bool DBWriter::pendingChunk(const ChunkPos &pos,string &serialized) {
+        boost::mutex::scoped_lock hold(lock);
+        chunk_map::iterator c=chunks.find(pos);
+        if (c==chunks.end()) {
+            // in flight data stays until committed so it is never
+            // missing from both here and the database
+            c=inflightChunks.find(pos);
+            if (c==inflightChunks.end())
+                return false;
+        }
+        serialized=c->second;
+        return true;
+    }
+
+    bool DBWriter::pendingPacked(const ChunkPos &pos,string &packed) {
+        string serialized;
+        if (!pendingChunk(pos,serialized))
+            return false;
+        packed.clear();
+        bvmap::packSerialized(serialized,codec,packed);
+        return true;
+    }
+
+    bool DBWriter::flush() {
+        boost::mutex::scoped_lock hold(lock);
+        if (worker==NULL)
+            return waiting()==0;
+        u64 target=lastSeq;
+        u64 failed=failures;
+        ++flushWaiters;
+        wake.notify_one();
+        while (doneSeq<target && failures==failed && worker!=NULL)
+            done.wait(hold);
+        --flushWaiters;
+        return doneSeq>=target;
+    }
+
+    void DBWriter::settle(const string &key) {
+        boost::mutex::scoped_lock hold(lock);
+        if (ops.count(key)==0 && inflightOps.count(key)==0)
+            return;
+        u64 failed=failures;
+        ++flushWaiters;
+        wake.notify_one();
+        while ((ops.count(key)>0 || inflightOps.count(key)>0) && failures==failed && worker!=NULL)
+            done.wait(hold);
+        --flushWaiters;
+    }
+
+    void DBWriter::run() {
+        unsigned attempts=0;
+        boost::mutex::scoped_lock hold(lock);
+        for (;;) {
+            while (!stopping && waiting()==0)
+                wake.wait(hold);
+            if (waiting()==0)
+                break;
+            // let writes collect for a while unless someone is waiting
+            boost::system_time until=boost::get_system_time()+linger;
+            while (!stopping && flushWaiters==0 && waiting()<batchMax)
+                if (!wake.timed_wait(hold,until))
+                    break;
+
+            u64 batchSeq=lastSeq;
+            inflightOps.swap(ops);
+            inflightChunks.swap(chunks);
+            bool giveUp=stopping && keptRounds>=max_attempts;
+            hold.unlock();
+            bool ok=commit();
+            u64 lost=0;
+            op_map kept;
+            if (!ok && ++attempts>=max_attempts) {
+                lost=isolate(kept,giveUp);
+                ok=true;
+            }
+            hold.lock();
+
+            if (ok) {
+                attempts=0;
+                if (kept.empty()) {
+                    doneSeq=batchSeq;
+                    keptRounds=0;
+                } else {
+                    // still owed so the batch is not done
+                    ++keptRounds;
+                    ++failures;
+                    for (auto &k : kept)
+                        if (!ops.insert(k).second)
+                            ++coalesced;
+                }
+                dropped+=lost;
+                ++batches;
+                inflightOps.clear();
+                inflightChunks.clear();
+            } else {
+                ++failures;
+                requeue();
+            }
+            done.notify_all();
+            if ((!ok || !kept.empty()) && !stopping)
+                wake.timed_wait(hold,linger);
+        }
+    }
+
+    bool DBWriter::commit() {
+        // row writes in the order they were made, then chunks
+        std::vector<const queued_op*> order;
+        order.reserve(inflightOps.size());
+        for (auto &o : inflightOps)
+            order.push_back(&o.second);
+        std::sort(order.begin(),order.end(),
+            [](const queued_op *a,const queued_op *b) {return a->seq<b->seq;});
+        try {
+            db->runOnce("BEGIN IMMEDIATE");
+            for (const queued_op *o : order)
+                o->op(*db);
+            for (auto &c : inflightChunks)
+                store->write(c.first,c.second);
+            db->runOnce("COMMIT");
+        } catch (std::exception &e) {
+            BVLOG_WARN("[DB] writer batch of " << (inflightOps.size()+inflightChunks.size())
+                       << " write(s) failed: " << e.what());
+            rollback(*db);
+            return false;
+        }
+        BVLOG_DEBUG("[DB] writer committed " << inflightOps.size() << " row write(s), "
+                    << inflightChunks.size() << " chunk(s)");
+        return true;
+    }
+
+    u64 DBWriter::isolate(op_map &kept,bool giveUp) {
+        u64 lost=0;
+        for (auto &o : inflightOps) {
+            try {
+                db->runOnce("BEGIN IMMEDIATE");
+                o.second.op(*db);
+                db->runOnce("COMMIT");
+            } catch (std::exception &e) {
+                rollback(*db);
+                if (o.second.keep && !giveUp) {
+                    BVLOG_WARN("[DB] writer will retry " << o.first << ": " << e.what());
+                    kept.insert(o);
+                } else {
+                    BVLOG_ERROR("[DB] writer dropped " << o.first << ": " << e.what());
+                    ++lost;
+                }
+            }
+        }
+        for (auto &c : inflightChunks) {
+            try {
+                db->runOnce("BEGIN IMMEDIATE");
+                store->write(c.first,c.second);
+                db->runOnce("COMMIT");
+            } catch (std::exception &e) {
+                BVLOG_ERROR("[DB] writer dropped chunk " << c.first.entityId << ':'
+                            << c.first.x << ',' << c.first.y << ',' << c.first.z << ": " << e.what());
+                rollback(*db);
+                ++lost;
+            }
+        }
+        return lost;
+    }
+
+    void DBWriter::requeue() {
+        // anything queued since the batch was taken is newer and wins
+        for (auto &o : inflightOps)
+            if (!ops.insert(o).second)
+                ++coalesced;
+        for (auto &c : inflightChunks)
+            if (!chunks.insert(c).second)
+                ++coalesced;
+        inflightOps.clear();
+        inflightChunks.clear();
+    }
+
+    size_t DBWriter::queued() {
+        boost::mutex::scoped_lock hold(lock);
+        return waiting()+inflightOps.size()+inflightChunks.size();
+    }
+
+    u64 DBWriter::submittedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return submitted;
+    }
+
+    u64 DBWriter::coalescedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return coalesced;
+    }
+
+    u64 DBWriter::batchCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return batches;
+    }
+
+    u64 DBWriter::failureCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return failures;
+    }
+
+    u64 DBWriter::droppedCount() {
+        boost::mutex::scoped_lock hold(lock);
+        return dropped;
+    }
+
+}
@@ -0,0 +1,171 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file dbwriter.hpp
+**
+**  World saves on a thread of their own
+**
+*/
+#ifndef BV_DBWRITER_HPP_INCLUDED
+#define BV_DBWRITER_HPP_INCLUDED
+
+#include "common.hpp"
+#include "chunkstore.hpp"
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace bv {
+
+    /**
+    *   @brief writes world changes to the database off the
+    *   session threads.
+    *
+    *   Callers hand over dirty chunks and row writes and go on;
+    *   the writer thread commits whatever has collected every
+    *   linger interval (sooner when batch_max writes are
+    *   waiting) in one transaction on its own connection.
+    *   Writes are keyed: a write replaces any still queued for
+    *   the same key (chunks are keyed by position) so a chunk or
+    *   row changed many times between commits is written once.
+    *
+    *   A failed batch is put back and retried.  After several
+    *   failures in a row each write is tried on its own and the
+    *   ones still failing are dropped (and logged) so that one bad
+    *   write cannot hold up the rest forever.  Writes queued with
+    *   keep set are never dropped while the writer runs: they go
+    *   back in the queue and are retried with the next batch.
+    *   Once stop() is called they get a few more rounds before
+    *   they are dropped too (so shutdown cannot hang on them).
+    *
+    *   After stop() the writer refuses new writes (until start()
+    *   is called again) rather than queue ones nothing will save.
+    *
+    *   Chunks saved but not yet committed are visible through
+    *   pendingChunk() so readers can look there before the
+    *   database.
+    *
+    *   All members may be called from any thread.
+    */
+    /** @brief write handed to a DBWriter that was stopped */
+    struct DBWriterStopped : public std::runtime_error {
+        DBWriterStopped(const char *msg) : std::runtime_error(msg) {}
+    };
+
+    class DBWriter : private boost::noncopyable {
+    public:
+        /** @brief a row write run inside the writer's transaction */
+        typedef boost::function<void(bvdb::SQLiteDB&)> write_op;
+
+    private:
+        struct queued_op {
+            u64 seq;        /**< @brief submission order */
+            write_op op;
+            bool keep;      /**< @brief retried rather than dropped */
+        };
+        typedef std::map<string,queued_op> op_map;
+        typedef std::map<bvmap::ChunkPos,string> chunk_map;
+
+        boost::mutex lock;
+        boost::condition_variable wake;     /**< @brief writer: work or stop */
+        boost::condition_variable done;     /**< @brief callers: batch finished */
+        boost::thread *worker;
+        bvdb::SQLiteDB *db;         /**< @brief writer's connection (writer thread only) */
+        bvmap::ChunkStore *store;   /**< @brief on db */
+        bool stopping;
+        bool stopped;               /**< @brief stop() ran and start() not since */
+
+        op_map ops;                 /**< @brief row writes not yet taken */
+        chunk_map chunks;           /**< @brief serialized chunks not yet taken */
+        op_map inflightOps;         /**< @brief row writes being committed */
+        chunk_map inflightChunks;   /**< @brief chunks being committed */
+
+        bvmap::codec_id codec;
+        boost::posix_time::time_duration linger;
+        size_t batchMax;
+
+        u64 lastSeq;                /**< @brief seq of the newest write */
+        u64 doneSeq;                /**< @brief all writes up to here are finished */
+        size_t flushWaiters;        /**< @brief callers in flush() (commit right away) */
+        u64 submitted;
+        u64 coalesced;              /**< @brief writes replaced before committing */
+        u64 batches;
+        u64 failures;               /**< @brief batches that failed */
+        u64 dropped;                /**< @brief writes given up on */
+        unsigned keptRounds;        /**< @brief batches in a row that kept failing writes */
+
+        size_t waiting() const {return ops.size()+chunks.size();}
+        void run();
+        bool commit();
+        u64 isolate(op_map &kept,bool giveUp);
+        void requeue();
+    public:
+        /**
+        *   @param packing codec chunks are stored with
+        *   @param interval how long writes collect before a commit
+        *   @param max writes waiting that start a commit early
+        */
+        explicit DBWriter(bvmap::codec_id packing=bvmap::codec_lz,
+                          boost::posix_time::time_duration interval=boost::posix_time::milliseconds(250),
+                          size_t max=4096);
+        /** @brief stop() if still running */
+        ~DBWriter();
+
+        /** @brief start the writer thread (opens its connection) */
+        void start();
+        /** @brief commit everything waiting and end the writer thread */
+        void stop();
+
+        /**
+        *   @brief queue op under key, replacing any op queued under key
+        *   @param keep retry op for as long as the writer runs instead of dropping it
+        *   @throw DBWriterStopped stop() was called
+        */
+        void put(const string &key,const write_op &op,bool keep=false);
+        /**
+        *   @brief queue c to be stored at pos
+        *   @throw DBWriterStopped stop() was called
+        */
+        void saveChunk(const bvmap::ChunkPos &pos,const bvmap::Chunk &c);
+        /**
+        *   @brief serialized chunk at pos not yet committed
+        *   @return false if the database is up to date for pos
+        */
+        bool pendingChunk(const bvmap::ChunkPos &pos,string &serialized);
+        /** @brief as pendingChunk() packed the way the store packs it */
+        bool pendingPacked(const bvmap::ChunkPos &pos,string &packed);
+
+        /**
+        *   @brief wait until everything queued before the call is committed
+        *   @return false if some of it failed (it is retried) or the writer is not running
+        */
+        bool flush();
+        /**
+        *   @brief wait until nothing is queued or being written under key
+        *   (or an attempt to write it failed)
+        */
+        void settle(const string &key);
+
+        /** @brief writes queued and not yet committed */
+        size_t queued();
+        u64 submittedCount();
+        u64 coalescedCount();
+        u64 batchCount();
+        u64 failureCount();
+        u64 droppedCount();
+    };
+
+}
+
+#endif // BV_DBWRITER_HPP_INCLUDED
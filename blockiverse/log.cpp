@@ -0,0 +1,202 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Implementation file log.cpp
+**
+**  Leveled asynchronous logging.
+**
+*/
+#include "log.hpp"
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+namespace bvlog {
+
+#ifdef PROTOCOL_VERBOSE
+    volatile int threshold=lvDebug;
+#else
+    volatile int threshold=lvInfo;
+#endif
+
+    namespace {
+
+        /** @brief piece of a message (long messages take several) */
+        struct record {
+            u32 more;           /**< @brief further pieces of the message follow */
+            u32 len;
+            char text[248];
+        };
+        /** @brief records per thread ring */
+        const size_t ring_records=512;
+
+        /**
+        *   @brief one thread's messages.
+        *
+        *   The owning thread is the only producer and the
+        *   flusher the only consumer.  When the thread ends
+        *   the ring is orphaned and the flusher deletes it
+        *   once drained.
+        */
+        struct thread_log {
+            boost::lockfree::spsc_queue<record,boost::lockfree::capacity<ring_records> > ring;
+            boost::atomic<bool> orphaned;
+            string partial;     // flusher only: message still arriving
+            thread_log() : orphaned(false) {}
+        };
+
+        void orphan(thread_log *tl) {
+            tl->orphaned=true;
+        }
+
+        boost::thread_specific_ptr<thread_log> mine(orphan);
+        boost::mutex rings_lock;        // guards rings and the flusher state
+        std::vector<thread_log*> rings;
+        boost::thread *flusher=NULL;
+        boost::atomic<bool> stopped(false);
+        boost::atomic<u64> drops(0);
+
+        /** @brief write out whatever a ring holds @return true if anything was written */
+        bool drain(thread_log *tl) {
+            record rec;
+            bool any=false;
+            while (tl->ring.pop(rec)) {
+                tl->partial.append(rec.text,rec.len);
+                if (!rec.more) {
+                    cout << tl->partial << '\n';
+                    tl->partial.clear();
+                }
+                any=true;
+            }
+            return any;
+        }
+
+        /** @brief pass over all rings, deleting drained orphans */
+        bool drain_all() {
+            bool any=false;
+            boost::mutex::scoped_lock hold(rings_lock);
+            LOCK_COUT
+            size_t i=0;
+            while (i<rings.size()) {
+                thread_log *tl=rings[i];
+                // orphaned is read first so nothing pushed before it is missed
+                bool gone=tl->orphaned;
+                any|=drain(tl);
+                if (gone) {
+                    delete tl;
+                    rings[i]=rings.back();
+                    rings.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+            UNLOCK_COUT
+            return any;
+        }
+
+        void flush_loop() {
+            for (;;) {
+                bool any=drain_all();
+                {
+                    boost::mutex::scoped_lock hold(rings_lock);
+                    if (stopped)
+                        return;
+                }
+                if (!any)
+                    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+            }
+        }
+
+        /** @brief calling thread's ring (NULL once logging has stopped) */
+        thread_log *ring_of_thread() {
+            thread_log *tl=mine.get();
+            if (tl==NULL) {
+                boost::mutex::scoped_lock hold(rings_lock);
+                if (stopped)
+                    return NULL;
+                tl=new thread_log;
+                rings.push_back(tl);
+                mine.reset(tl);
+                if (flusher==NULL)
+                    flusher=new boost::thread(flush_loop);
+            }
+            return tl;
+        }
+
+    }   // anonymous
+
+    void write(level lv,const string &text) {
+        static const char *tag[]={"","","[warn] ","[error] "};
+        string tagged;
+        if (lv>=lvWarn)
+            tagged=tag[lv]+text;
+        const string &msg=(lv>=lvWarn)?tagged:text;
+        thread_log *tl=stopped?NULL:ring_of_thread();
+        if (tl==NULL) {
+            LOCK_COUT
+            cout << msg << endl;
+            UNLOCK_COUT
+            return;
+        }
+        const size_t piece=sizeof(((record*)NULL)->text);
+        size_t pieces=(msg.size()+piece-1)/piece;
+        if (pieces==0)
+            pieces=1;
+        if (tl->ring.write_available()<pieces) {
+            ++drops;
+            return;
+        }
+        record rec;
+        size_t at=0;
+        for (size_t i=0;i<pieces;++i) {
+            rec.len=std::min(piece,msg.size()-at);
+            rec.more=(i+1<pieces);
+            memcpy(rec.text,msg.data()+at,rec.len);
+            at+=rec.len;
+            tl->ring.push(rec);
+        }
+    }
+
+    u64 dropped() {
+        return drops;
+    }
+
+    void stop() {
+        boost::thread *done;
+        {
+            boost::mutex::scoped_lock hold(rings_lock);
+            stopped=true;
+            done=flusher;
+            flusher=NULL;
+        }
+        if (done!=NULL) {
+            done->join();
+            delete done;
+        }
+        // anything queued after the flusher's last pass
+        {
+            boost::mutex::scoped_lock hold(rings_lock);
+            LOCK_COUT
+            for (auto tl : rings)
+                drain(tl);
+            UNLOCK_COUT
+        }
+        if (drops>0) {
+            LOCK_COUT
+            cout << "[log] " << drops << " message(s) dropped" << endl;
+            UNLOCK_COUT
+        }
+    }
+
+}   // bvlog
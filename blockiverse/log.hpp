@@ -0,0 +1,90 @@
+/*
+**
+**  Minetest-Blockiverse
+**
+**  Incorporates portions of code from minetest 0.4.10-dev
+**
+**  Blockiverse
+**  Copyright (C) 2014 Brian Jack <gau_veldt@hotmail.com>
+**  Distributed as free software using the copyleft
+**  LGPL Version 3 license:
+**  https://www.gnu.org/licenses/lgpl-3.0.en.html
+**  See file LICENSE in ../
+**
+**  Declaration (header) file log.hpp
+**
+**  Leveled asynchronous logging.
+**
+**  Each thread formats its messages into its own lock-free
+**  ring and a background flusher thread does the output, so
+**  logging never takes a lock shared with other threads or
+**  waits on the console.  A full ring drops messages rather
+**  than block.  Debug messages only exist in builds defining
+**  PROTOCOL_VERBOSE (the Debug targets) and compile to nothing
+**  otherwise.
+**
+**  Usage (message is anything that can follow cout <<):
+**
+**      BVLOG_INFO("session [" << this << "] booted");
+**
+*/
+#ifndef BV_LOG_HPP_INCLUDED
+#define BV_LOG_HPP_INCLUDED
+
+#include "common.hpp"
+#include <sstream>
+
+namespace bvlog {
+
+    /** @brief message severity */
+    typedef enum {
+        lvDebug=0,      /**< @brief chatter, compiled out of release builds */
+        lvInfo=1,       /**< @brief normal operation */
+        lvWarn=2,       /**< @brief something unexpected but handled */
+        lvError=3       /**< @brief something failed */
+    } level;
+
+    /** @brief least severe level currently written */
+    extern volatile int threshold;
+
+    /** @brief true if messages of level lv are currently written */
+    inline bool enabled(level lv) {return lv>=threshold;}
+    /** @brief change least severe level written */
+    inline void set_level(level lv) {threshold=lv;}
+
+    /**
+    *   @brief queue message on the calling thread's ring.
+    *
+    *   Never blocks.  The first message from a thread sets up
+    *   its ring and starts the flusher if need be.  After stop()
+    *   messages are written straight out instead.
+    */
+    void write(level lv,const string &msg);
+
+    /** @brief messages dropped because a ring was full */
+    u64 dropped();
+
+    /** @brief write out everything queued and end the flusher (call before exit) */
+    void stop();
+
+}   // bvlog
+
+#define BVLOG_AT(lv,msg) \
+    do { \
+        if (bvlog::enabled(lv)) { \
+            std::ostringstream bvlog_line; \
+            bvlog_line << msg; \
+            bvlog::write(lv,bvlog_line.str()); \
+        } \
+    } while (0)
+
+#ifdef PROTOCOL_VERBOSE
+#define BVLOG_DEBUG(msg) BVLOG_AT(bvlog::lvDebug,msg)
+#else
+#define BVLOG_DEBUG(msg) do {} while (0)
+#endif
+#define BVLOG_INFO(msg)  BVLOG_AT(bvlog::lvInfo,msg)
+#define BVLOG_WARN(msg)  BVLOG_AT(bvlog::lvWarn,msg)
+#define BVLOG_ERROR(msg) BVLOG_AT(bvlog::lvError,msg)
+
+#endif // BV_LOG_HPP_INCLUDED
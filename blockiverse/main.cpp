@@ -181,9 +181,6 @@ using bvclient::ClientFrontEnd;
 
 int main(int argc, char** argv)
 {
-    extern void protocol_main_init();
-    protocol_main_init();
-
     boost::thread *server_thread=NULL;
     argset args(argc,argv);
 
@@ -244,7 +241,8 @@ int main(int argc, char** argv)
         LOCK_COUT
         cout << "[Standalone] Waiting for server startup..." << endl;
         UNLOCK_COUT
-        while (!serverReady) {
+        // a server that failed to start is no longer active
+        while (!serverReady && serverActive) {
             FrontEnd.run();
         }
         LOCK_COUT
@@ -338,7 +336,7 @@ int main(int argc, char** argv)
     cout << "client session ["
               << &client_session << "]" << endl;;
     UNLOCK_COUT
-    clientRoot client_root(client_session);
+    clientRoot client_root(client_session,FrontEnd.getChunks());
     int port=v2int(config["port"]);
     std::ostringstream s_port;
     s_port << port;
@@ -423,6 +421,7 @@ int main(int argc, char** argv)
         UNLOCK_COUT
 
         if (acctId>0){
+            client_root.setAccount(acctId);
             FrontEnd.clearGUI();
 
             if (vdrv==EDT_OPENGL) {
@@ -487,13 +486,10 @@ int main(int argc, char** argv)
     socket.close();
 
     if (standalone) {
-        // defibrilates main server thread if blocked
         LOCK_COUT
         cout << "Requesting server quit." << endl;
         UNLOCK_COUT
         req_serverQuit=true;
-        boost::asio::connect(socket,target);
-        socket.close();
 
         LOCK_COUT
         cout << "Waiting for server shutdown." << endl;
@@ -505,5 +501,6 @@ int main(int argc, char** argv)
         }
     }
 
+    bvlog::stop();
     return 0;
 }
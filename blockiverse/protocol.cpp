@@ -23,21 +23,7 @@ int pow2_tbl[]={1,2,4,8};         /* 2^x */
 
 boost::mutex cout_mutex;
 
-/** @var bvnet::reg_object_softmax @brief Maximum size of object registry */
-u32 bvnet::reg_objects_softmax=1000;
-
-typedef bvnet::type_map::value_type mappedType;
-
-/** @var bvnet::typeMap @brief Used by serialization to encode or decode protocol valuetypes to actual data types */
-bvnet::type_map bvnet::typeMap;
-
-void protocol_main_init() {
-    bvnet::typeMap.insert(mappedType(typeid(s64                ).name(),bvnet::vtInt));
-    bvnet::typeMap.insert(mappedType(typeid(float              ).name(),bvnet::vtFloat));
-    //bvnet::typeMap.insert(mappedType(typeid(string       ).name(),bvnet::vtBlob));
-    bvnet::typeMap.insert(mappedType(typeid(string       ).name(),bvnet::vtString));
-    bvnet::typeMap.insert(mappedType(typeid(bvnet::obref      ).name(),bvnet::vtObref));
-    bvnet::typeMap.insert(mappedType(typeid(bvnet::ob_is_gone ).name(),bvnet::vtDeath));
-    bvnet::typeMap.insert(mappedType(typeid(bvnet::method_call).name(),bvnet::vtMethod));
-    bvnet::typeMap.insert(mappedType(typeid(bvnet::dmc_msg    ).name(),bvnet::vtDMC));
-}
+/** @var bvnet::reg_object_softmax @brief Default maximum size of object registry */
+u32 bvnet::reg_objects_softmax=65536;
+/** @var bvnet::reg_mem_budget @brief Default memory budget of object registry */
+size_t bvnet::reg_mem_budget=16*1024*1024;
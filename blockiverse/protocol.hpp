@@ -40,6 +40,7 @@
 #define BV_PROTOCOL_H_INCLUDED
 
 #include "common.hpp"
+#include "log.hpp"
 #include <memory>
 #include <functional>
 #include <iomanip>
@@ -47,15 +48,19 @@
 #include <exception>
 #include <stack>
 #include <queue>
-#include <boost/any.hpp>
 #include <boost/thread/mutex.hpp>
-#include <boost/bimap.hpp>
 #include <boost/bind.hpp>
 #include <boost/asio.hpp>
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
 #include <boost/core/enable_if.hpp>
 #include <boost/type_traits.hpp>
+#include <boost/array.hpp>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
 
 using boost::asio::ip::tcp;
 typedef boost::asio::io_service io_service;
@@ -67,6 +72,32 @@ typedef boost::function<void()> lpvFunc;
 
 namespace bvnet {
     extern u32 reg_objects_softmax;
+    extern size_t reg_mem_budget;
+
+    /**
+    * @brief Protocol revision spoken by this build.
+    *
+    *   1: one value per opcode, each read separately off the stream
+    *   2: values batched into length-prefixed frames
+    *   3: floats and doubles sent as raw IEEE 754 instead of text
+    *
+    * Each endpoint announces its revision with a V message and only
+    * switches to the framed encoding once the remote has announced
+    * a revision supporting it.
+    */
+    const u32 protocol_version=3;
+    /** @brief largest frame payload accepted from the remote */
+    const u32 frame_max=16*1024*1024;
+    /** @brief largest string accepted from the remote */
+    const u32 string_max=1024*1024;
+    /** @brief largest blob accepted from the remote */
+    const u32 blob_max=frame_max;
+    /** @brief largest dmc method label accepted from the remote */
+    const u32 label_max=255;
+    /** @brief idle receive buffers a session keeps for reuse */
+    const size_t rx_pool_keep=4;
+    /** @brief largest receive buffer kept for reuse */
+    const size_t rx_pool_cap=64*1024;
 
     using boost::enable_if;
     using boost::is_base_of;
@@ -82,17 +113,19 @@ namespace bvnet {
     typedef enum {
         vtInt=1,        /**< @brief Variable-length integer */
         vtFloat=2,      /**< @brief Floating-point value */
-        vtBlob=3,       /**< @brief Arbitrary binary data (currently same as String) */
+        vtBlob=3,       /**< @brief Arbitrary binary data */
         vtString=4,     /**< @brief Length-prefixed string */
         vtObref=5,      /**< @brief Object reference */
         vtDeath=6,      /**< @brief Object no longer exists */
         vtMethod=7,     /**< @brief Object method call */
-        vtDMC=8         /**< @brief dmc message */
+        vtDMC=8,        /**< @brief dmc message */
+        vtVersion=9,    /**< @brief Protocol revision announcement */
+        vtDouble=10     /**< @brief Double precision floating-point value */
     } valtype;
-    /** @typedef type_map @brief map of protocol valuetype class to corresponding data type */
-    typedef std::map<const char*,valtype> type_map;
-    /** @brief used by serialization to encode or decode protocol valuetypes to actual data types */
-    extern type_map typeMap;
+    /** @brief one past the highest valtype (for per-type tables) */
+    const int vt_count=11;
+
+    struct label_stats;
 
     /** @brief protocol valuetype class for object reference */
     struct obref {
@@ -115,7 +148,9 @@ namespace bvnet {
         u32 idx;
         lpvFunc callbk;
         size_t rcount;
-        method_call(u32 i,u32 m,lpvFunc cb,int rnum):id(i),idx(m),callbk(cb),rcount(rnum) {}
+        u64 sent_ns;            /**< @brief when queued (for round trip timing) */
+        label_stats *stats;     /**< @brief per-label statistics when called by name */
+        method_call(u32 i,u32 m,lpvFunc cb,int rnum):id(i),idx(m),callbk(cb),rcount(rnum),sent_ns(0),stats(NULL) {}
         ~method_call() {}
     };
     /** @brief protocol valuetype class for dmc messages */
@@ -124,26 +159,247 @@ namespace bvnet {
         string label;
         u32 slot;
     };
+    /** @brief shared receive buffer (frames and unframed blobs) */
+    typedef std::shared_ptr<std::vector<char> > rx_buffer;
+
+    /**
+    *   @brief protocol valuetype class for binary blobs
+    *
+    *   A received blob is a slice of the buffer it arrived in
+    *   and keeps that buffer alive rather than copying out of it.
+    *   Locally made blobs own a private buffer.
+    */
+    struct blob {
+        rx_buffer owner;
+        const char *ptr;
+        u32 len;
+        blob() : ptr(NULL),len(0) {}
+        blob(const rx_buffer &buf,const char *p,u32 n) : owner(buf),ptr(p),len(n) {}
+        blob(const string &s) :
+            owner(new std::vector<char>(s.begin(),s.end())),
+            ptr(owner->data()),len(s.size()) {}
+        const char *data() const {return ptr;}
+        size_t size() const {return len;}
+        string str() const {return string(ptr,len);}
+    };
+    /** @brief protocol valuetype class for protocol revision announcement */
+    struct proto_ver {
+        u32 ver;
+        proto_ver(u32 v):ver(v) {}
+    };
+
+    /** @brief Indicates value taken from the stack as the wrong type */
+    class bad_value_cast : public exception {
+        virtual const char *what() const throw();
+    };
+
+    /**
+    *   @brief Tagged protocol value.
+    *
+    *   Holds exactly one of the protocol valuetypes along with
+    *   its valtype tag so encoding and argument checks are a
+    *   switch on the tag.  Strings up to sso_max bytes are kept
+    *   inline in the value itself, longer ones in a std::string.
+    */
+    class value {
+    public:
+        enum {sso_max=22};
+    private:
+        valtype tag;
+        bool inl;                   /**< @brief vtString held in sso */
+        union {
+            s64 i;
+            float f;
+            double d;
+            u32 id;                 /**< @brief vtObref, vtDeath, vtVersion */
+            struct {
+                unsigned char len;
+                char buf[sso_max];
+            } sso;
+            string str;
+            method_call mc;
+            dmc_msg dmc;
+            blob bl;
+        };
+        void set_string(const char *p,size_t len) {
+            tag=vtString;
+            inl=(len<=sso_max);
+            if (inl) {
+                sso.len=len;
+                memcpy(sso.buf,p,len);
+            } else {
+                new (&str) string(p,len);
+            }
+        }
+        void copy_from(const value &o) {
+            tag=o.tag;
+            inl=o.inl;
+            switch (tag) {
+            case vtString:
+                if (inl) sso=o.sso;
+                else new (&str) string(o.str);
+                break;
+            case vtMethod:
+                new (&mc) method_call(o.mc);
+                break;
+            case vtDMC:
+                new (&dmc) dmc_msg(o.dmc);
+                break;
+            case vtBlob:
+                new (&bl) blob(o.bl);
+                break;
+            default:
+                i=o.i;
+                break;
+            }
+        }
+        void move_from(value &o) {
+            tag=o.tag;
+            inl=o.inl;
+            switch (tag) {
+            case vtString:
+                if (inl) sso=o.sso;
+                else new (&str) string(std::move(o.str));
+                break;
+            case vtMethod:
+                new (&mc) method_call(std::move(o.mc));
+                break;
+            case vtDMC:
+                new (&dmc) dmc_msg(std::move(o.dmc));
+                break;
+            case vtBlob:
+                new (&bl) blob(std::move(o.bl));
+                break;
+            default:
+                i=o.i;
+                break;
+            }
+        }
+        void release() {
+            switch (tag) {
+            case vtString:
+                if (!inl) str.~string();
+                break;
+            case vtMethod:
+                mc.~method_call();
+                break;
+            case vtDMC:
+                dmc.~dmc_msg();
+                break;
+            case vtBlob:
+                bl.~blob();
+                break;
+            default:
+                break;
+            }
+            tag=valtype(0);
+        }
+        void expect(valtype t) const {
+            if (tag!=t) throw bad_value_cast();
+        }
+    public:
+        value() : tag(valtype(0)),inl(false),i(0) {}
+        value(s64 v) : tag(vtInt),inl(false),i(v) {}
+        value(float v) : tag(vtFloat),inl(false),f(v) {}
+        value(double v) : tag(vtDouble),inl(false),d(v) {}
+        value(const string &v) {set_string(v.data(),v.size());}
+        value(const char *v) {set_string(v,strlen(v));}
+        value(const char *p,size_t len) {set_string(p,len);}
+        value(const obref &v) : tag(vtObref),inl(false),id(v.id) {}
+        value(const ob_is_gone &v) : tag(vtDeath),inl(false),id(v.id) {}
+        value(const proto_ver &v) : tag(vtVersion),inl(false),id(v.ver) {}
+        value(const method_call &v) : tag(vtMethod),inl(false) {new (&mc) method_call(v);}
+        value(const dmc_msg &v) : tag(vtDMC),inl(false) {new (&dmc) dmc_msg(v);}
+        value(const blob &v) : tag(vtBlob),inl(false) {new (&bl) blob(v);}
+        value(const value &o) {copy_from(o);}
+        value(value &&o) {move_from(o);}
+        ~value() {release();}
+        value &operator=(const value &o) {
+            if (this!=&o) {
+                release();
+                copy_from(o);
+            }
+            return *this;
+        }
+        value &operator=(value &&o) {
+            if (this!=&o) {
+                release();
+                move_from(o);
+            }
+            return *this;
+        }
+
+        /** @brief valuetype held */
+        valtype type() const {return tag;}
+        /** @brief string or blob bytes (no copy) @throw bad_value_cast if neither */
+        const char *data() const {
+            if (tag==vtBlob) return bl.data();
+            expect(vtString);
+            return inl?sso.buf:str.data();
+        }
+        /** @brief string or blob length @throw bad_value_cast if neither */
+        size_t size() const {
+            if (tag==vtBlob) return bl.size();
+            expect(vtString);
+            return inl?sso.len:str.size();
+        }
+        /** @brief held method call @throw bad_value_cast if not a method call */
+        const method_call &call() const {expect(vtMethod); return mc;}
+        /** @brief held dmc message @throw bad_value_cast if not a dmc message */
+        const dmc_msg &dmc_of() const {expect(vtDMC); return dmc;}
+        /** @brief held object id (obref, death or version) */
+        u32 id_of() const {return id;}
+
+        /**
+        *   @brief Extract held value as type T.
+        *   @throw bad_value_cast if value holds some other type
+        */
+        template<typename T> T as() const;
+    };
+    template<> inline s64 value::as<s64>() const {expect(vtInt); return i;}
+    template<> inline float value::as<float>() const {expect(vtFloat); return f;}
+    /** @brief floats widen losslessly so either is accepted as a double */
+    template<> inline double value::as<double>() const {
+        if (tag==vtFloat) return f;
+        expect(vtDouble);
+        return d;
+    }
+    template<> inline string value::as<string>() const {return string(data(),size());}
+    template<> inline obref value::as<obref>() const {expect(vtObref); return obref(id);}
+    template<> inline ob_is_gone value::as<ob_is_gone>() const {expect(vtDeath); return ob_is_gone(id);}
+    template<> inline proto_ver value::as<proto_ver>() const {expect(vtVersion); return proto_ver(id);}
+    template<> inline method_call value::as<method_call>() const {return call();}
+    template<> inline dmc_msg value::as<dmc_msg>() const {return dmc_of();}
+    template<> inline blob value::as<blob>() const {expect(vtBlob); return bl;}
 
     class object;
     class registry;
     class connection;
 
-    typedef struct {} object_id;
-    typedef struct {} object_addr;
-    typedef boost::bimaps::tagged<u32,object_id> t_obId;
-    typedef boost::bimaps::tagged<object*,object_addr> t_obAddr;
-    typedef boost::bimap<t_obId,t_obAddr> object_map;
-    typedef object_map::value_type ob_relation;
-    typedef object_map::map_by<object_id>::iterator omap_iter_byid;
-    typedef object_map::map_by<object_addr>::iterator omap_iter_byptr;
-    typedef object_map::map_by<object_id>::type omap_select_id;
-    typedef object_map::map_by<object_addr>::type omap_select_addr;
+    /**
+    *   @brief object id layout
+    *
+    *   The low reg_slot_bits of an id are its registry slot plus one
+    *   (so no id is ever 0) and the remaining high bits are the
+    *   slot's generation, bumped each time the slot is vacated.
+    */
+    const u32 reg_slot_bits=20;
+    const u32 reg_slot_mask=(1u<<reg_slot_bits)-1;
+    const u32 reg_gen_limit=1u<<(32-reg_slot_bits);
+
+    /** @brief registry slot: occupant (or NULL), current generation and memory charged */
+    struct reg_slot {
+        object *ob;
+        u32 gen;
+        size_t cost;
+    };
+    typedef std::vector<reg_slot> slot_vec;
+    typedef std::unordered_map<object*,u32> object_ids;
 
     /** @brief incoming value stack to receive incoming data */
-    typedef std::stack<boost::any> value_stack;
+    typedef std::stack<value> value_stack;
     /** @brief queued outgoing data waiting for transfer */
-    typedef std::queue<boost::any> value_queue;
+    typedef std::queue<value> value_queue;
     typedef std::map<u32,bool> proxy_map;
     typedef std::queue<method_call> cb_queue;
     typedef boost::mutex mutex;
@@ -155,10 +411,14 @@ namespace bvnet {
     typedef std::map<string,u32> indx_map;
     typedef std::map<u32,indx_map> iface_map;
 
-    /** @brief Indicates registry exceeded reg_objects_softmax */
+    /** @brief Indicates registry exceeded its object count or memory budget */
     class registry_full : public exception {
         mutable char buf[80];
+        bool byBudget;
+        size_t limit;
         virtual const char *what() const throw();
+    public:
+        registry_full(bool budget,size_t lim) : byBudget(budget),limit(lim) {}
     };
     /** @brief Indicates attempt to register NULL object */
     class object_null : public exception {
@@ -172,6 +432,14 @@ namespace bvnet {
     class argstack_empty : public exception {
         virtual const char *what() const throw();
     };
+    /** @brief Indicates remote announced a value longer than allowed */
+    class value_too_large : public exception {
+        virtual const char *what() const throw();
+    };
+    /** @brief Indicates a frame whose contents do not decode cleanly */
+    class bad_frame : public exception {
+        virtual const char *what() const throw();
+    };
     class method_notimpl : public exception {
         mutable char buf[80];
         string dmcOb;
@@ -182,6 +450,166 @@ namespace bvnet {
             dmcOb(ob),dmcMethodId(slot) {}
     };
 
+    /** @brief monotonic nanoseconds for protocol timings */
+    inline u64 stats_clock() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /** @brief statistics of one method label */
+    struct label_stats {
+        u64 calls_in;           /**< @brief calls received and run */
+        u64 exec_ns;            /**< @brief time spent running them */
+        u64 calls_out;          /**< @brief calls sent to the remote */
+        u64 replies;            /**< @brief sent calls whose results arrived */
+        u64 rtt_ns;             /**< @brief total round trip of those */
+        label_stats() : calls_in(0),exec_ns(0),calls_out(0),replies(0),rtt_ns(0) {}
+    };
+    typedef std::map<string,label_stats> label_stat_map;
+
+    /** @brief round trip histogram buckets: bucket k counts trips under 2^k microseconds */
+    const int rtt_buckets=24;
+
+    /**
+    *   @brief Protocol statistics of a session.
+    *
+    *   Received byte counts cover framed traffic (revision 2 on),
+    *   unframed values are counted but not their bytes.
+    */
+    struct session_stats {
+        u64 values_tx[vt_count];
+        u64 bytes_tx[vt_count];
+        u64 values_rx[vt_count];
+        u64 bytes_rx[vt_count];
+        u64 frames_tx;
+        u64 frames_rx;
+        size_t argstack_hwm;    /**< @brief deepest argstack */
+        size_t sendq_hwm;       /**< @brief longest send queue */
+        u64 encode_ns;          /**< @brief time spent encoding */
+        u64 decode_ns;          /**< @brief time spent decoding frames (calls included) */
+        u64 rtt_hist[rtt_buckets+1]; /**< @brief last bucket catches everything longer */
+        label_stat_map methods;
+
+        session_stats() :
+            frames_tx(0),frames_rx(0),argstack_hwm(0),sendq_hwm(0),
+            encode_ns(0),decode_ns(0) {
+            memset(values_tx,0,sizeof(values_tx));
+            memset(bytes_tx,0,sizeof(bytes_tx));
+            memset(values_rx,0,sizeof(values_rx));
+            memset(bytes_rx,0,sizeof(bytes_rx));
+            memset(rtt_hist,0,sizeof(rtt_hist));
+        }
+        /** @brief account a result arriving for a call sent at sent_ns */
+        void round_trip(const method_call &mc) {
+            u64 ns=stats_clock()-mc.sent_ns;
+            u64 us=ns/1000;
+            int k=0;
+            while (k<rtt_buckets && us>=(u64(1)<<k))
+                ++k;
+            ++rtt_hist[k];
+            if (mc.stats!=NULL) {
+                ++mc.stats->replies;
+                mc.stats->rtt_ns+=ns;
+            }
+        }
+        /** @brief write as a single JSON object */
+        void write_json(std::ostream &os) const;
+    };
+
+    inline void session_stats::write_json(std::ostream &os) const {
+        static const char *vt_name[vt_count]={
+            "none","int","float","blob","string","obref",
+            "death","method","dmc","version","double"
+        };
+        os << "{\"types\":{";
+        bool first=true;
+        for (int t=1;t<vt_count;++t) {
+            if (!first) os << ',';
+            first=false;
+            os << '"' << vt_name[t] << "\":{"
+               << "\"values_tx\":" << values_tx[t]
+               << ",\"bytes_tx\":" << bytes_tx[t]
+               << ",\"values_rx\":" << values_rx[t]
+               << ",\"bytes_rx\":" << bytes_rx[t] << '}';
+        }
+        os << "},\"frames_tx\":" << frames_tx
+           << ",\"frames_rx\":" << frames_rx
+           << ",\"argstack_hwm\":" << argstack_hwm
+           << ",\"sendq_hwm\":" << sendq_hwm
+           << ",\"encode_ns\":" << encode_ns
+           << ",\"decode_ns\":" << decode_ns
+           << ",\"rtt_us_log2\":[";
+        for (int k=0;k<=rtt_buckets;++k)
+            os << (k?",":"") << rtt_hist[k];
+        os << "],\"methods\":{";
+        first=true;
+        for (auto &m : methods) {
+            if (!first) os << ',';
+            first=false;
+            /* labels are identifiers, escape just enough to stay valid */
+            os << '"';
+            for (char c : m.first) {
+                if (c=='"' || c=='\\') os << '\\';
+                if ((unsigned char)c>=32) os << c;
+            }
+            os << "\":{"
+               << "\"calls_in\":" << m.second.calls_in
+               << ",\"exec_ns\":" << m.second.exec_ns
+               << ",\"calls_out\":" << m.second.calls_out
+               << ",\"replies\":" << m.second.replies
+               << ",\"rtt_ns\":" << m.second.rtt_ns << '}';
+        }
+        os << "}}";
+    }
+
+    /**
+    *   @brief Per-session pool of receive buffers.
+    *
+    *   Frames (and unframed blobs) are read into buffers from here.
+    *   A buffer goes back into circulation once no blob still refers
+    *   to it, so steady traffic settles on a few buffers grown to the
+    *   working size instead of an allocation per frame.
+    *
+    *   Buffers larger than rx_pool_cap are handed out unpooled and
+    *   freed once the last blob using them goes, so one large frame
+    *   does not pin its size for the rest of the session.
+    */
+    class rx_pool {
+    private:
+        std::vector<rx_buffer> idle;
+    public:
+        /** @brief buffer of len bytes, reused when one is free */
+        rx_buffer get(size_t len) {
+            if (len>rx_pool_cap)
+                return rx_buffer(new std::vector<char>(len));
+            rx_buffer *pick=NULL;
+            for (auto &buf : idle) {
+                if (buf.use_count()==1) {
+                    if (pick==NULL || (*pick)->capacity()<len)
+                        pick=&buf;
+                    if ((*pick)->capacity()>=len)
+                        break;
+                }
+            }
+            if (pick==NULL) {
+                rx_buffer fresh(new std::vector<char>);
+                if (idle.size()<rx_pool_keep)
+                    idle.push_back(fresh);
+                fresh->resize(len);
+                return fresh;
+            }
+            (*pick)->resize(len);
+            return *pick;
+        }
+        /** @brief bytes held by pooled buffers */
+        size_t footprint() const {
+            size_t total=0;
+            for (auto &buf : idle)
+                total+=buf->capacity();
+            return total;
+        }
+    };
+
     /**
     *   @brief Symmetrical endpoint session for established connection.
     *
@@ -212,10 +640,122 @@ namespace bvnet {
         bool _float_or_semi;        /**< @brief expecting floating point chars or terminating ; */
         bool _neg_int;              /**< @brief got - meaning incoming int is a negative */
         bool _opcode_read_queued;   /**< @brief when true already waiting for opcode to arrive */
+        bool _framed_tx;            /**< @brief remote understands frames so send values batched */
+        bool _framed_rx;            /**< @brief remote sends frames so read whole frame headers */
         string _fpstr;         /**< @brief accumulator to receive incoming floating point value  */
         char in_ch;                 /**< @brief the character just received */
         char in_idx[4];             /**< @brief the uint32 just received */
         char in_s64[8];             /**< @brief the sint64 just received */
+        rx_buffer in_frame;         /**< @brief payload of the frame being received */
+        rx_pool rxbufs;             /**< @brief reusable receive buffers */
+        char in_label[label_max];   /**< @brief dmc label being received */
+        string tx_pending;          /**< @brief encoded values awaiting the next write */
+        string tx_flight;           /**< @brief encoded values being written (kept for reuse) */
+        bool _write_in_flight;      /**< @brief tx_flight is being written */
+        u32 remoteVersion;          /**< @brief protocol revision announced by remote (0=unknown) */
+        session_stats stats;        /**< @brief protocol statistics */
+        io_service::strand *strand_;/**< @brief serializes this session's handlers */
+        bool _pumped;               /**< @brief session re-arms itself (shared io_service mode) */
+        bool _closing;              /**< @brief socket closed, waiting out pending handlers */
+        unsigned _rx_ops;           /**< @brief reads in flight */
+        unsigned _tx_ops;           /**< @brief writes in flight */
+        unsigned _timer_ops;        /**< @brief deadline and ticker waits in flight */
+        boost::asio::deadline_timer *deadline_; /**< @brief see expire() */
+        /** @brief one periodic callback (see every()) */
+        struct ticker {
+            boost::asio::deadline_timer *timer;
+            boost::posix_time::time_duration period;
+            boost::function<void()> tick;
+            bool armed;                         /**< @brief a wait is outstanding */
+            ticker() : timer(NULL),armed(false) {}
+        };
+        /** @brief tickers by key (kept until the session ends so handlers may point at them) */
+        std::map<string,ticker> tickers_;
+        boost::function<void()> on_close; /**< @brief called once a pumped session is finished */
+
+        /**
+        *   @brief completion handler wrapper
+        *
+        *   Counts the operation as finished then runs the handler.
+        *   A pumped session has nobody calling run() so the wrapper
+        *   also contains handler exceptions and re-arms the session
+        *   (or begins closing it) afterwards.
+        */
+        template<typename H> class pumped {
+        private:
+            session *s;
+            unsigned *ops;
+            H h;
+        public:
+            pumped(session *sess,unsigned *count,H handler) : s(sess),ops(count),h(handler) {}
+            template<typename... A> void operator()(A&&... a) {
+                --*ops;
+                if (!s->_pumped) {
+                    h(std::forward<A>(a)...);
+                    /* a waiting deadline would keep run() from returning */
+                    if (!s->isActive)
+                        s->cancel_deadline();
+                    else if (s->_rx_ops==0 && s->_timer_ops>0)
+                        s->io_->stop();
+                    return;
+                }
+                try {
+                    h(std::forward<A>(a)...);
+                } catch (exception &e) {
+                    s->isActive=false;
+                    BVLOG_INFO("Session [" << s << "] closed: " << e.what());
+                }
+                s->after_handler();
+            }
+        };
+        /** @brief wrap completion handler to run on the session strand
+        *   @param ops counter of the kind of operation being started */
+        template<typename H>
+        auto pump(unsigned &ops,H h) -> decltype(std::declval<io_service::strand&>().wrap(pumped<H>(this,&ops,h))) {
+            ++ops;
+            return strand_->wrap(pumped<H>(this,&ops,h));
+        }
+        /** @brief pumped mode: send what is queued and keep a read waiting, or finish closing */
+        void after_handler();
+        /** @brief stop waiting on any deadline or ticker */
+        void cancel_deadline() {
+            boost::system::error_code ignored;
+            if (deadline_!=NULL)
+                deadline_->cancel(ignored);
+            for (auto &t : tickers_) {
+                t.second.timer->cancel(ignored);
+                t.second.armed=false;
+            }
+        }
+        /** @brief wait for the next tick of t */
+        void arm_ticker(ticker &t);
+
+        /** @brief receive buffer from rxbufs (pooled ones charged to the budget) */
+        rx_buffer rx_take(size_t len);
+        /** @brief queue read of next opcode (or frame header) if not already waiting */
+        void queue_read();
+        /** @brief encode all queued values (as frames when remote supports them) then write */
+        void flush_sendq();
+        /** @brief arm callback of a method call once it has been encoded */
+        void arm_notify(const method_call &mc);
+        /** @brief write out tx_pending unless a write is already in flight */
+        void start_write();
+        /** @brief append wire form of one value to buffer @return its valtype (0 if unknown) */
+        valtype serialize(string &out,const value &raw);
+        /** @brief synchronously decode all values in a received frame */
+        void decode(const char *p,size_t len);
+        /** @brief completed value handlers shared by stream and frame decoders */
+        void recv_value(value &&val);
+        /** @brief completed value handlers shared by stream and frame decoders */
+        void recv_oref(u32 idx);
+        /** @brief completed value handlers shared by stream and frame decoders */
+        void recv_dead(u32 obid);
+        /** @brief completed value handlers shared by stream and frame decoders */
+        void recv_call(u32 obid,u32 idx);
+        /** @brief completed value handlers shared by stream and frame decoders */
+        void recv_dmc(const dmc_msg &mk_dmc);
+        /** @brief completed value handlers shared by stream and frame decoders */
+        void recv_version(u32 ver);
     protected:
         /** @brief various async data reception callbacks */
         void on_recv(const boost::system::error_code &ec,size_t rlen);
@@ -228,20 +768,32 @@ namespace bvnet {
         /** @brief various async data reception callbacks */
         void on_recv_oref(const boost::system::error_code &ec,size_t rlen);
         /** @brief various async data reception callbacks */
-        void on_recv_str(const boost::system::error_code &ec,char *buf);
+        void on_recv_str(const boost::system::error_code &ec,rx_buffer buf,bool isBlob);
         /** @brief various async data reception callbacks */
-        void on_recv_len(const boost::system::error_code &ec,size_t rlen);
+        void on_recv_len(const boost::system::error_code &ec,bool isBlob);
         /** @brief various async data reception callbacks */
         void on_recv_s64(const boost::system::error_code &ec,u32 bsize);
         /** @brief various async data reception callbacks */
         void on_recv_dmc_obid(const boost::system::error_code &ec);
         void on_recv_dmc_len(const boost::system::error_code &ec,dmc_msg mk_dmc);
-        void on_recv_dmc_label(const boost::system::error_code &ec,dmc_msg mk_dmc,char* buf);
+        void on_recv_dmc_label(const boost::system::error_code &ec,dmc_msg mk_dmc,u32 len);
         void on_recv_dmc_slot(const boost::system::error_code &ec,dmc_msg mk_dmc);
+        /** @brief various async data reception callbacks */
+        void on_recv_real(const boost::system::error_code &ec,u32 bsize);
+        /** @brief various async data reception callbacks */
+        void on_recv_version(const boost::system::error_code &ec);
+        /** @brief various async data reception callbacks */
+        void on_recv_frame_hdr(const boost::system::error_code &ec);
+        /** @brief various async data reception callbacks */
+        void on_recv_frame_len(const boost::system::error_code &ec);
+        /** @brief various async data reception callbacks */
+        void on_recv_frame(const boost::system::error_code &ec,size_t rlen);
         /** @brief various async trasnfer completion callbacks */
-        void on_write_done(string *finsihedbuf);
-        /** @brief various async trasnfer completion callbacks */
-        void on_write_call_done(string *finishedbuf,lpvFunc cb);
+        void on_write_done(const boost::system::error_code &ec);
+        /** @brief deadline set by expire() reached */
+        void on_deadline(const boost::system::error_code &ec,boost::function<bool()> keep);
+        /** @brief period set by every() elapsed for t */
+        void on_ticker(const boost::system::error_code &ec,ticker *t);
         /** @brief notifies callback when expected number of return arguments arrive */
         void check_argnotify();
 
@@ -284,24 +836,31 @@ namespace bvnet {
         /** @brief close the conncetion */
         void disconnect() {isActive=false;}
         /** @brief register object as available to remote */
-        int register_object(object *o);
+        u32 register_object(object *o);
+        /** @brief charge memory held by object against session's budget
+        *   @throw registry_full if that exceeds the budget */
+        void charge(object *o,size_t bytes);
+        /** @brief limit objects registered and memory they may charge */
+        void set_object_limits(u32 objects,size_t budget);
         /** @brief get remote's root (bootstrap) object */
         u32 getRemote() {return remoteRoot;}
+        /** @brief protocol revision in use with remote */
+        u32 getVersion() {return std::min(protocol_version,std::max(remoteVersion,1u));}
         /** @brief true indicates remote root object valid */
         bool hasRemote() {return 0!=remoteRoot;}
         /** @brief unregister object by-id and inform remote */
         bool unregister(u32 id);
         /** @brief unregister object by-address and inform remote */
         bool unregister(object *ob);
-        /** @brief sends any queued values over the wire */
-        void encode(const boost::any &a);
+        /** @brief encodes value into the outgoing buffer (written on next pump) */
+        void encode(const value &a);
         /**
         * @brief Determine type of result stack top value.
         * @throw argstack_empty if the result stack is empty when attempted
         */
         valtype argtype() {
             if (argstack.size()>0) {
-                return typeMap[argstack.top().type().name()];
+                return argstack.top().type();
             }
             throw argstack_empty();
         }
@@ -319,7 +878,7 @@ namespace bvnet {
         template<typename V>
         V getarg() {
             if (argstack.size()>0) {
-                V rc=boost::any_cast<V>(argstack.top());
+                V rc=argstack.top().template as<V>();
                 argstack.pop();
                 return rc;
             }
@@ -330,8 +889,9 @@ namespace bvnet {
         void send_int(s64 val) {sendq.push(val);}               /**< @brief send int to remote */
         //void send_int(s64 &val) {sendq.push(val);}
         void send_float(float val) {sendq.push(val);}           /**< @brief send float to remote */
+        void send_double(double val) {sendq.push(val);}         /**< @brief send double to remote */
         //void send_float(float &val) {sendq.push(val);}
-        void send_blob(string val) {sendq.push(val);}      /**< @brief send blob (as string) to remote */
+        void send_blob(string val) {sendq.push(blob(val));} /**< @brief send blob to remote */
         //void send_blob(string &val) {sendq.push(val);}
         void send_string(string val) {sendq.push(val);}    /**< @brief send string to remote */
         //void send_string(string &val) {sendq.push(val);}
@@ -348,15 +908,23 @@ namespace bvnet {
         *          Default: 0 (no values returned).
         */
         void send_call(u32 id,u32 m,lpvFunc cb=NULL,int rcount=0) {
-            sendq.push(method_call(id,m,cb,rcount));
+            method_call mc(id,m,cb,rcount);
+            mc.sent_ns=stats_clock();
+            sendq.push(mc);
         }
         void send_call(u32 id,string m_name,lpvFunc cb=NULL,int rcount=0) {
             if (contracts.find(id)==contracts.end())
                 throw object_not_reg();
             if (contracts[id].find(m_name)==contracts[id].end())
                 throw method_notimpl(m_name,-1);
-            sendq.push(method_call(id,contracts[id][m_name],cb,rcount));
+            method_call mc(id,contracts[id][m_name],cb,rcount);
+            mc.sent_ns=stats_clock();
+            mc.stats=&stats.methods[m_name];
+            ++mc.stats->calls_out;
+            sendq.push(mc);
         }
+        /** @brief protocol statistics of this session */
+        const session_stats &getStats() {return stats;}
         /** @brief Queries if an object still valid  and useable on remote.
         *   @param obid object id.
         *   @return true if oject useable false otherwise.
@@ -368,6 +936,40 @@ namespace bvnet {
         bool run();
         /** @brief network pump - returns to allow other activy whilst waiting. */
         bool poll();
+        /**
+        *   @brief hand the session over to its io_service.
+        *
+        *   Instead of a thread calling run() the session re-arms
+        *   itself from its own completion handlers, so any number
+        *   of threads may run a shared io_service and an idle
+        *   session holds no thread.  Handlers of one session run
+        *   on its strand so never concurrently.
+        *
+        *   @param closed called (from an io_service thread) once
+        *   the connection is down and no handler is outstanding,
+        *   after which the session may be deleted.
+        */
+        void start(boost::function<void()> closed);
+        /**
+        *   @brief drop the connection unless a condition holds in time.
+        *
+        *   After the delay keep() is consulted (on the session's
+        *   strand) and the session is closed if it returns false.
+        *   Replaces any earlier deadline.  Must be called before
+        *   run()/start() or from one of the session's handlers.
+        */
+        void expire(boost::posix_time::time_duration after,boost::function<bool()> keep);
+        /**
+        *   @brief call tick() periodically while the session lives.
+        *
+        *   tick() runs on the session's strand like any other
+        *   handler and whatever it sends is flushed afterwards.
+        *   Each key has its own ticker: a call replaces the one
+        *   under the same key only, and an empty tick stops it.
+        *   Must be called before run()/start() or from one of the
+        *   session's handlers.
+        */
+        void every(const string &key,boost::posix_time::time_duration period,boost::function<void()> tick);
         /** @brief get outgoing value queue for this session */
         value_queue &getSendQueue() {return sendq;}
         /** @brief get thread lock for this session */
@@ -376,9 +978,10 @@ namespace bvnet {
         void set_conn(tcp::socket &s) {
             conn=&s;
             io_=&(s.get_io_service());
-            LOCK_COUT
-            cout << "session [" << this << "] on socket " << conn << " via io=" << io_ << endl;
-            UNLOCK_COUT
+            if (strand_!=NULL)
+                delete strand_;
+            strand_=new io_service::strand(*io_);
+            BVLOG_DEBUG("session [" << this << "] on socket " << conn << " via io=" << io_);
         }
         /** @brief for debugging - dumps data about session */
         void dump(std::ostream &os);
@@ -404,16 +1007,59 @@ namespace bvnet {
         mutex *synchro;     /**< @brief mutex on registry manipulation */
         session *listener;  /**< @brief notify sink for object removals */
 
-        u32 next_slot;          /**< @brief id for next object [must be thread-synced] */
-        object_map objects;     /**< @brief registered objects [must be thread-synced] */
+        slot_vec slots;         /**< @brief registered objects by slot [must be thread-synced] */
+        std::vector<u32> vacant;/**< @brief reusable slot indices [must be thread-synced] */
+        object_ids ids;         /**< @brief id of each registered object [must be thread-synced] */
+        u32 max_objects;        /**< @brief object count limit */
+        size_t mem_budget;      /**< @brief limit on memory charged by objects */
+        size_t mem_used;        /**< @brief memory charged by registered objects and the session */
+        size_t mem_session;     /**< @brief memory charged by the session itself */
+        size_t mem_peak;        /**< @brief most memory charged at once */
+        u32 objects_peak;       /**< @brief most objects registered at once */
+        u32 refused;            /**< @brief registrations and charges refused */
+
+        /** @brief add bytes to a slot's charge @throw registry_full if over budget */
+        void charge(reg_slot &slot,size_t bytes) {
+            if (bytes>mem_budget-mem_used) {
+                ++refused;
+                throw registry_full(true,mem_budget);
+            }
+            slot.cost+=bytes;
+            mem_used+=bytes;
+            mem_peak=std::max(mem_peak,mem_used);
+        }
+
+        /** @brief slot referenced by id or NULL if id is stale or invalid */
+        reg_slot *slotOf(u32 id) {
+            u32 idx=(id&reg_slot_mask)-1;
+            if (idx>=slots.size())
+                return NULL;
+            reg_slot &slot=slots[idx];
+            if (slot.ob==NULL || slot.gen!=(id>>reg_slot_bits))
+                return NULL;
+            return &slot;
+        }
+        /** @brief empty slot referenced by (valid) id */
+        void vacate(u32 id);
     public:
         /** @brief constructor @param host The session reisgtry works for. */
-        registry(session *host) : listener(host),next_slot(1)
+        registry(session *host) :
+            listener(host),max_objects(reg_objects_softmax),mem_budget(reg_mem_budget),
+            mem_used(0),mem_session(0),mem_peak(0),objects_peak(0),refused(0)
             {synchro=new mutex();}
         /** @brief destructor */
         virtual ~registry();
         /** @brief add object to registry */
-        int register_object(object *ob);
+        u32 register_object(object *ob);
+        /** @brief set limits on object count and memory charged */
+        void set_limits(u32 objects,size_t budget) {max_objects=objects; mem_budget=budget;}
+        /** @brief charge memory held by registered object against the budget */
+        void charge(object *ob,size_t bytes);
+        /**
+        *   @brief set the memory the session itself holds (replaces the last figure)
+        *   @throw registry_full if that exceeds the budget
+        */
+        void charge_session(size_t bytes);
         /** @brief notify upstream of object destruction @param id id of affected object @return allocated slot*/
         void notify(u32 id);
         /** @brief remove object from registry by-id @param id id of object to unregister */
@@ -520,22 +1166,30 @@ namespace bvnet {
         }
 
         void dmc_GetType(value_queue&);         /**< @brief the GetType dispatched method call (dmc) */
+
+        /**
+        *   @brief charge memory against the session's object budget
+        *
+        *   Derived ctors charge what they add to the base object
+        *   (their own size and whatever they allocate) so the
+        *   session budget reflects what its objects really cost.
+        *   The charge is returned when the object unregisters.
+        *
+        *   @throw registry_full if the session budget is exceeded
+        */
+        void charge(size_t bytes) {ctx.charge(this,bytes);}
     public:
         /** @brief construction of an object @param sess reference to session to attach */
         object(session &sess) :
             ctx(sess) {
-                LOCK_COUT
-                cout << "object [" << this << "] ctor" << endl;
-                UNLOCK_COUT
+                BVLOG_DEBUG("object [" << this << "] ctor");
                 ctx.register_object(this);
                 // dmcTable[0] is the GetType method
                 register_dmc("GetType",&object::dmc_GetType);
             }
         /** @brief base dtor to automatically unregister the object */
         virtual ~object() {
-            LOCK_COUT
-            cout << "object [" << this << "] dtor (using session " << &ctx << ')' << endl;
-            UNLOCK_COUT
+            BVLOG_DEBUG("object [" << this << "] dtor (using session " << &ctx << ')');
             ctx.unregister(this);
         }
         /**
@@ -557,15 +1211,19 @@ namespace bvnet {
     /*
     **  Registry inlines
     */
-    inline int registry::register_object(object *ob) {
-        int chosen_slot; // local value other threads can't modify
+    inline u32 registry::register_object(object *ob) {
+        u32 chosen_slot; // local value other threads can't modify
         /**
         **  Insert object ob into registry and return slot id
         **  the object was registered to.
         **  @param ob ptr to object to register
-        **  @return slot id object registered to
+        **  @return slot id object registered to (the one it
+        **          already has if it is registered)
         **  @throw object_null I refuse to register NULLs
         **  @throw registry_full Reigstry exceeded size limit - DDoS mitigation.
+        **
+        **  The base object is charged against the memory budget
+        **  here, derived classes charge anything further they hold.
         */
 
         if (ob==NULL) {
@@ -573,7 +1231,16 @@ namespace bvnet {
             throw object_null();
         }
 
-        if (objects.size()>=reg_objects_softmax) {
+        /*
+        ** registering twice would take a second slot and orphan
+        ** the first (never vacated, never uncharged) so the
+        ** object keeps the id it already has
+        */
+        object_ids::iterator known=ids.find(ob);
+        if (known!=ids.end())
+            return known->second;
+
+        if (ids.size()>=max_objects || sizeof(object)>mem_budget-mem_used) {
             /*
             ** enforce an object store softmax
             **
@@ -584,53 +1251,94 @@ namespace bvnet {
             ** store hardmax which may lead to a system crash and subsequent
             ** collateral damage.
             */
-            throw registry_full();
+            ++refused;
+            if (ids.size()>=max_objects)
+                throw registry_full(false,max_objects);
+            throw registry_full(true,mem_budget);
         }
 
         /*
-            For security do not assume next_slot+1
-            is an unoccupied slot.
+            For security an id must never come back into use while
+            the remote may still hold it.
 
             An attacker could use rapid creation and deletion of
-            objects to execute a wraparound attack on next_slot
-            then register a new object in a low numbered slot to
-            overwrite an existing object in the registry.
+            objects to cycle a slot through its generations and
+            then have a stale reference resolve to whatever object
+            occupies the slot now.  A slot whose generation would
+            wrap is therefore retired (never reused) rather than
+            returned to the vacant list.
         */
-        omap_select_id &table=objects.by<object_id>();
-        omap_iter_byid row=table.find(next_slot);
-        while (row!=table.end()) {
-            ++next_slot;
-            /* skip 0 as it's reserved */
-            if (next_slot==0) ++next_slot;
-            row=table.find(next_slot);
+        u32 idx;
+        if (vacant.size()>0) {
+            idx=vacant.back();
+            vacant.pop_back();
+        } else {
+            if (slots.size()>=reg_slot_mask)
+                throw registry_full(false,reg_slot_mask);
+            idx=slots.size();
+            slots.push_back((reg_slot){NULL,0,0});
         }
-        /* invariant: objects[next_slot] empty */
+        reg_slot &slot=slots[idx];
+        slot.ob=ob;
+        charge(slot,sizeof(object));
 
         /* make thread-safe copy for retval */
-        chosen_slot=next_slot;
+        chosen_slot=(slot.gen<<reg_slot_bits)|(idx+1);
 
         /* register object */
-        objects.insert(ob_relation(chosen_slot,ob));
+        ids[ob]=chosen_slot;
+        objects_peak=std::max<u32>(objects_peak,ids.size());
 
         return chosen_slot;
     }
 
+    inline void registry::charge(object *ob,size_t bytes) {
+        object_ids::iterator row=ids.find(ob);
+        if (row==ids.end()) throw object_not_reg();
+        charge(slots[(row->second&reg_slot_mask)-1],bytes);
+    }
+
+    inline void registry::charge_session(size_t bytes) {
+        if (bytes>mem_session) {
+            size_t more=bytes-mem_session;
+            if (more>mem_budget-mem_used) {
+                ++refused;
+                throw registry_full(true,mem_budget);
+            }
+            mem_used+=more;
+            mem_peak=std::max(mem_peak,mem_used);
+        } else {
+            mem_used-=mem_session-bytes;
+        }
+        mem_session=bytes;
+    }
+
     inline void registry::notify(u32 id) {
         if (listener!=NULL) {
             listener->notify_remove(id);
         }
     }
 
+    inline void registry::vacate(u32 id) {
+        u32 idx=(id&reg_slot_mask)-1;
+        reg_slot &slot=slots[idx];
+        ids.erase(slot.ob);
+        slot.ob=NULL;
+        mem_used-=slot.cost;
+        slot.cost=0;
+        if (++slot.gen<reg_gen_limit)
+            vacant.push_back(idx);
+        /* else retired, see register_object */
+    }
+
     inline bool registry::unregister(u32 id) {
         /*
         **  remove object from registry
         **  and notify upstream event sink
         */
-        omap_select_id &table=objects.by<object_id>();
-        omap_iter_byid victim=table.find(id);
-        if (victim!=table.end()) {
+        if (slotOf(id)!=NULL) {
             notify(id);
-            table.erase(victim);
+            vacate(id);
             return true;
         }
         return false;
@@ -643,11 +1351,11 @@ namespace bvnet {
         */
         if (ob==NULL) return false;     /* indicate not found if NULL */
 
-        omap_select_addr &table=objects.by<object_addr>();
-        omap_iter_byptr victim=table.find(ob);
-        if (victim!=table.end()) {
-            notify(victim->get<object_id>());
-            table.erase(victim);
+        object_ids::iterator victim=ids.find(ob);
+        if (victim!=ids.end()) {
+            u32 id=victim->second;
+            notify(id);
+            vacate(id);
             return true;
         }
         return false;
@@ -658,29 +1366,22 @@ namespace bvnet {
         **  get identify (objectref) of pointed object
         */
         if (ob==NULL) throw object_not_reg();   /* indicate DNE if NULL */
-        {
-            omap_select_addr &table=objects.by<object_addr>();
-            omap_iter_byptr row=table.find(ob);
-            if (row!=table.end()) {
-                return row->get<object_id>();
-            }
-            throw object_not_reg();
+        object_ids::iterator row=ids.find(ob);
+        if (row!=ids.end()) {
+            return row->second;
         }
+        throw object_not_reg();
     }
 
     inline object* registry::obOf(u32 id) {
         /*
         **  get identify (objectref) of pointed object
         */
-        if (id==0) throw object_not_reg();  /* object id==0 is reserved */
-        {
-            omap_select_id &table=objects.by<object_id>();
-            omap_iter_byid row=table.find(id);
-            if (row!=table.end()) {
-                return row->get<object_addr>();
-            }
-            throw object_not_reg();
+        reg_slot *slot=slotOf(id);  /* id 0 is reserved so never found */
+        if (slot!=NULL) {
+            return slot->ob;
         }
+        throw object_not_reg();
     }
 
     inline registry::~registry() {
@@ -689,28 +1390,33 @@ namespace bvnet {
             ** destructor must cleanly clear/notify
             ** any remaining objects
             */
-            omap_select_id &table=objects.by<object_id>();
-            omap_iter_byid row=table.begin();
-            while (row!=table.end()) {
-                notify(row->get<object_id>());
-                /* post-increment iter to keep valid */
-                table.erase(row++);
+            for (u32 idx=0;idx<slots.size();++idx) {
+                reg_slot &slot=slots[idx];
+                if (slot.ob!=NULL) {
+                    u32 id=(slot.gen<<reg_slot_bits)|(idx+1);
+                    notify(id);
+                    vacate(id);
+                }
             }
         }
         delete synchro;
         synchro=NULL;
-        LOCK_COUT
-        cout << "Registry [" << this << "] gone" << endl;
-        UNLOCK_COUT
+        BVLOG_DEBUG("Registry [" << this << "] gone");
     }
 
     /*
     **  Error message inlines
     */
     inline const char *registry_full::what() const throw() {
-        snprintf(buf,sizeof(buf),
-                 "Registry full: exceeded %d maximum objects.",
-                 reg_objects_softmax);
+        if (byBudget) {
+            snprintf(buf,sizeof(buf),
+                     "Registry full: exceeded %lu byte object budget.",
+                     (unsigned long)limit);
+        } else {
+            snprintf(buf,sizeof(buf),
+                     "Registry full: exceeded %lu maximum objects.",
+                     (unsigned long)limit);
+        }
         return buf;
     }
     inline const char *object_null::what() const throw() {
@@ -722,6 +1428,15 @@ namespace bvnet {
     inline const char *argstack_empty::what() const throw() {
         return "Object access when argument stack is empty.";
     }
+    inline const char *bad_value_cast::what() const throw() {
+        return "Protocol value is not of the requested type.";
+    }
+    inline const char *value_too_large::what() const throw() {
+        return "Value length exceeds protocol limit.";
+    }
+    inline const char *bad_frame::what() const throw() {
+        return "Malformed or truncated frame.";
+    }
     inline const char *method_notimpl::what() const throw() {
         snprintf(buf,sizeof(buf),
                  "Method %s.%d not implemented.",
@@ -740,7 +1455,18 @@ namespace bvnet {
         _float_or_semi=false;
         _neg_int=false;
         _opcode_read_queued=false;
+        _framed_tx=false;
+        _framed_rx=false;
+        _write_in_flight=false;
+        remoteVersion=0;
         remoteRoot=0;
+        strand_=NULL;
+        _pumped=false;
+        _closing=false;
+        _rx_ops=0;
+        _tx_ops=0;
+        _timer_ops=0;
+        deadline_=NULL;
     }
 
     inline session::~session() {
@@ -750,9 +1476,13 @@ namespace bvnet {
 
         delete reg;
         delete synchro;
-        LOCK_COUT
-        cout << "Session [" << this << "] gone" << endl;
-        UNLOCK_COUT
+        if (deadline_!=NULL)
+            delete deadline_;
+        for (auto &t : tickers_)
+            delete t.second.timer;
+        if (strand_!=NULL)
+            delete strand_;
+        BVLOG_DEBUG("Session [" << this << "] gone");
     }
 
     /** Updates known interface of specifed object
@@ -763,11 +1493,9 @@ namespace bvnet {
     *   @param slot     [in] slot number used to call the new method
     */
     inline void session::UpdateInterface(u32 ob,string label,u32 slot) {
-        LOCK_COUT
-        cout << "Session [" << this << "] remote obid "
+        BVLOG_DEBUG("Session [" << this << "] remote obid "
              << ob << " added method " << label
-             << " (slot=" << slot << ")" << endl;
-        UNLOCK_COUT
+             << " (slot=" << slot << ")");
         contracts[ob][label]=slot;
     }
     /** @brief Determine registry id given object ptr */
@@ -820,9 +1548,20 @@ namespace bvnet {
     inline void session::notify_remove(u32 id) {
         sendq.push(ob_is_gone(id));
     }
-    inline int session::register_object(object *o) {
+    inline u32 session::register_object(object *o) {
         return reg->register_object(o);
     }
+    inline void session::charge(object *o,size_t bytes) {
+        reg->charge(o,bytes);
+    }
+    inline rx_buffer session::rx_take(size_t len) {
+        rx_buffer buf=rxbufs.get(len);
+        reg->charge_session(rxbufs.footprint());
+        return buf;
+    }
+    inline void session::set_object_limits(u32 objects,size_t budget) {
+        reg->set_limits(objects,budget);
+    }
     inline bool session::unregister(u32 id) {
         return reg->unregister(id);
     }
@@ -830,82 +1569,68 @@ namespace bvnet {
         return reg->unregister(ob);
     }
     inline void session::bootstrap(object *sessionRoot) {
-        boost::any a;
         root=sessionRoot;
+        sendq.push(proto_ver(protocol_version));
         sendq.push(obref(reg->idOf(root)));
         isActive=true;
     }
-    inline void session::on_write_done(string *finishedbuf) {
-        delete finishedbuf;
-    }
-    inline void session::on_write_call_done(string *finishedbuf,lpvFunc cb) {
-        delete finishedbuf;
-        cb();
+    inline void session::on_write_done(const boost::system::error_code &ec) {
+        _write_in_flight=false;
+        tx_flight.clear();
+        if (!ec) {
+            start_write();
+        } else {
+            BVLOG_INFO("session [" << this
+                      << "] write failed"
+                      << " (" << ec << ")");
+            isActive=false;
+        }
     }
     inline void session::on_recv_oref(const boost::system::error_code &ec,size_t rlen) {
         if (isActive) {
             if (!ec) {
-                u32 idx=*((u32*)in_idx);
-                proxy[idx]=true;
-                if (isBooting) {
-                    LOCK_COUT
-                    cout << "session [" << this
-                              << "] booted: remote root=" << idx
-                              << endl;
-                    UNLOCK_COUT
-                    remoteRoot=idx;
-                    // booted once root known
-                    isBooting=false;
-                } else {
-                    argstack.push(obref(idx));
-                    check_argnotify();
-                }
+                recv_oref(*((u32*)in_idx));
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected objectref got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
     }
-    inline void session::on_recv_str(const boost::system::error_code &ec,char* buf) {
+    inline void session::on_recv_str(const boost::system::error_code &ec,rx_buffer buf,bool isBlob) {
         if (!ec) {
-            argstack.push(string(buf));
-            check_argnotify();
+            if (isBlob) {
+                recv_value(blob(buf,buf->data(),buf->size()));
+            } else {
+                recv_value(value(buf->data(),buf->size()));
+            }
         } else {
-            LOCK_COUT
-            cout << "session [" << this
+            BVLOG_INFO("session [" << this
                       << "] expected string data got EOF"
-                      << " (" << ec << ")"
-                      << endl;
-            UNLOCK_COUT
+                      << " (" << ec << ")");
             isActive=false;
         }
-        delete [] buf;
     }
-    inline void session::on_recv_len(const boost::system::error_code &ec,size_t rlen) {
+    inline void session::on_recv_len(const boost::system::error_code &ec,bool isBlob) {
         if (isActive) {
             if (!ec) {
                 u32 idx=*((u32*)in_idx);
-                char* pstr=new char[1+idx];
-                pstr[idx]='\0';
+                /* refuse before allocating anything */
+                if (idx>(isBlob?blob_max:string_max))
+                    throw value_too_large();
+                rx_buffer buf=rx_take(idx);
                 boost::asio::async_read(
                     *conn,
-                    boost::asio::buffer(pstr,idx),
-                    boost::bind(&session::on_recv_str,this,
+                    boost::asio::buffer(buf->data(),idx),
+                    pump(_rx_ops,boost::bind(&session::on_recv_str,this,
                         boost::asio::placeholders::error,
-                        pstr));
+                        buf,isBlob)));
 
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected string len got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
@@ -913,23 +1638,11 @@ namespace bvnet {
     inline void session::on_recv_dead_obid(const boost::system::error_code &ec) {
         if (isActive) {
             if (!ec) {
-                u32 obid=*((u32*)in_idx);
-                /* proxy eliminates need for death messages in argstack */
-                proxy.erase(obid);
-                /* if there's a contract cached remove it also */
-                auto iface=contracts.find(obid);
-                if (iface!=contracts.end())
-                    contracts.erase(obid);
-                LOCK_COUT
-                cout << "session [" << this << "] recv ~" << obid << endl;
-                UNLOCK_COUT
+                recv_dead(*((u32*)in_idx));
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected dead objectid got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
@@ -941,16 +1654,13 @@ namespace bvnet {
                 boost::asio::async_read(
                     *conn,
                     boost::asio::buffer(in_idx,4),
-                    boost::bind(&session::on_recv_call_idx,this,
+                    pump(_rx_ops,boost::bind(&session::on_recv_call_idx,this,
                         boost::asio::placeholders::error,
-                        obid));
+                        obid)));
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected callee objectid got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
@@ -963,16 +1673,13 @@ namespace bvnet {
                 boost::asio::async_read(
                     *conn,
                     boost::asio::buffer(in_idx,4),
-                    boost::bind(&session::on_recv_dmc_len,this,
+                    pump(_rx_ops,boost::bind(&session::on_recv_dmc_len,this,
                         boost::asio::placeholders::error,
-                        mk_dmc));
+                        mk_dmc)));
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected dmc objectid got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
@@ -981,66 +1688,51 @@ namespace bvnet {
         if (isActive) {
             if (!ec) {
                 u32 idx=*((u32*)in_idx);
-                char* pstr=new char[1+idx];
-                pstr[idx]='\0';
+                if (idx>label_max)
+                    throw value_too_large();
                 boost::asio::async_read(
                     *conn,
-                    boost::asio::buffer(pstr,idx),
-                    boost::bind(&session::on_recv_dmc_label,this,
+                    boost::asio::buffer(in_label,idx),
+                    pump(_rx_ops,boost::bind(&session::on_recv_dmc_label,this,
                         boost::asio::placeholders::error,
-                        mk_dmc,pstr));
+                        mk_dmc,idx)));
 
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected dmc objectid got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
     }
-    inline void session::on_recv_dmc_label(const boost::system::error_code &ec,dmc_msg mk_dmc,char* buf) {
+    inline void session::on_recv_dmc_label(const boost::system::error_code &ec,dmc_msg mk_dmc,u32 len) {
         if (isActive) {
             if (!ec) {
-                mk_dmc.label=buf;
+                mk_dmc.label.assign(in_label,len);
                 boost::asio::async_read(
                     *conn,
                     boost::asio::buffer(in_idx,4),
-                    boost::bind(&session::on_recv_dmc_slot,this,
+                    pump(_rx_ops,boost::bind(&session::on_recv_dmc_slot,this,
                         boost::asio::placeholders::error,
-                        mk_dmc));
+                        mk_dmc)));
 
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected string data got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
-        delete [] buf;
     }
     inline void session::on_recv_dmc_slot(const boost::system::error_code &ec,dmc_msg mk_dmc) {
         if (isActive) {
             if (!ec) {
                 mk_dmc.slot=*((u32*)in_idx);
-                contracts[mk_dmc.ob][mk_dmc.label]=mk_dmc.slot;
-                LOCK_COUT
-                cout << "session [" << this << "] recv dmc ("
-                     << mk_dmc.ob << "." << mk_dmc.label
-                     << "=" << mk_dmc.slot << ")" << endl;
-                UNLOCK_COUT
+                recv_dmc(mk_dmc);
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected dmc objectid got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
@@ -1048,21 +1740,11 @@ namespace bvnet {
     inline void session::on_recv_call_idx(const boost::system::error_code &ec,u32 obid) {
         if (isActive) {
             if (!ec) {
-                u32 idx=*((u32*)in_idx);
-                object *ob=reg->obOf(obid);
-                LOCK_COUT
-                cout << "Session [" << this << "] call "
-                          << ob->getType() << '[' << ob << "]." << ob->methodLabel(idx)
-                          << endl;
-                UNLOCK_COUT
-                ob->methodCall(idx);
+                recv_call(obid,*((u32*)in_idx));
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected method idx got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
@@ -1073,16 +1755,103 @@ namespace bvnet {
                 s64 *in_val=(s64*)in_s64;
                 s64 val=*in_val;
                 if (_neg_int) val=-val;
-                argstack.push(val);
-                check_argnotify();
                 _neg_int=false;
+                recv_value(val);
             } else {
-                LOCK_COUT
-                cout << "session [" << this
+                BVLOG_INFO("session [" << this
                           << "] expected " << bsize << "-byte int got EOF"
-                          << " (" << ec << ")"
-                          << endl;
-                UNLOCK_COUT
+                          << " (" << ec << ")");
+                isActive=false;
+            }
+        }
+    }
+    inline void session::on_recv_real(const boost::system::error_code &ec,u32 bsize) {
+        if (isActive) {
+            if (!ec) {
+                if (bsize==4) {
+                    float flt;
+                    memcpy(&flt,in_s64,4);
+                    recv_value(flt);
+                } else {
+                    double dbl;
+                    memcpy(&dbl,in_s64,8);
+                    recv_value(dbl);
+                }
+            } else {
+                BVLOG_INFO("session [" << this
+                          << "] expected " << bsize << "-byte real got EOF"
+                          << " (" << ec << ")");
+                isActive=false;
+            }
+        }
+    }
+    inline void session::on_recv_version(const boost::system::error_code &ec) {
+        if (isActive) {
+            if (!ec) {
+                recv_version(*((u32*)in_idx));
+            } else {
+                BVLOG_INFO("session [" << this
+                          << "] expected protocol version got EOF"
+                          << " (" << ec << ")");
+                isActive=false;
+            }
+        }
+    }
+    inline void session::on_recv_frame_hdr(const boost::system::error_code &ec) {
+        if (isActive) {
+            if (!ec) {
+                if (in_ch!='{') {
+                    /* remote went back to unframed values */
+                    throw bad_frame();
+                }
+                on_recv_frame_len(ec);
+            } else {
+                BVLOG_INFO("session [" << this
+                          << "] expected frame got EOF"
+                          << " (" << ec << ")");
+                isActive=false;
+            }
+        }
+    }
+    inline void session::on_recv_frame_len(const boost::system::error_code &ec) {
+        if (isActive) {
+            if (!ec) {
+                u32 len=*((u32*)in_idx);
+                if (len>frame_max) {
+                    throw bad_frame();
+                }
+                if (len==0) {
+                    _opcode_read_queued=false;
+                    return;
+                }
+                /* a blob may still hold the last frame so take from the pool */
+                in_frame=rx_take(len);
+                boost::asio::async_read(
+                    *conn,
+                    boost::asio::buffer(in_frame->data(),len),
+                    pump(_rx_ops,boost::bind(&session::on_recv_frame,this,
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred)));
+            } else {
+                BVLOG_INFO("session [" << this
+                          << "] expected frame len got EOF"
+                          << " (" << ec << ")");
+                isActive=false;
+            }
+        }
+    }
+    inline void session::on_recv_frame(const boost::system::error_code &ec,size_t rlen) {
+        /* frame complete so next header may be read */
+        _opcode_read_queued=false;
+        if (isActive) {
+            if (!ec) {
+                ++stats.frames_rx;
+                decode(in_frame->data(),rlen);
+                in_frame.reset();
+            } else {
+                BVLOG_INFO("session [" << this
+                          << "] expected frame data got EOF"
+                          << " (" << ec << ")");
                 isActive=false;
             }
         }
@@ -1091,15 +1860,13 @@ namespace bvnet {
         _opcode_read_queued=false;
         if (isActive) {
             if (!ec) {
-                int ich=int((unsigned char)in_ch);
                 if (_float_or_semi) {
                     if (in_ch==';') {
                         _float_or_semi=false;
                         float flt;
                         std::istringstream cvt(_fpstr);
                         cvt >> flt;
-                        argstack.push(flt);
-                        check_argnotify();
+                        recv_value(flt);
                     } else {
                         _fpstr+=in_ch;
                     }
@@ -1122,9 +1889,9 @@ namespace bvnet {
                         boost::asio::async_read(
                             *conn,
                             boost::asio::buffer(in_s64,bsize),
-                            boost::bind(&session::on_recv_s64,this,
+                            pump(_rx_ops,boost::bind(&session::on_recv_s64,this,
                                 boost::asio::placeholders::error,
-                                bsize));
+                                bsize)));
                         break;
                     case '-':
                         _neg_int=true;
@@ -1136,74 +1903,315 @@ namespace bvnet {
                         _float_or_semi=true;
                         _fpstr.clear();
                         break;
+                    case 'r':
+                    case 'd':
+                        bsize=(in_ch=='r')?4:8;
+                        boost::asio::async_read(
+                            *conn,
+                            boost::asio::buffer(in_s64,bsize),
+                            pump(_rx_ops,boost::bind(&session::on_recv_real,this,
+                                boost::asio::placeholders::error,
+                                bsize)));
+                        break;
                     case '"':
                     case 'b':
                         boost::asio::async_read(
                             *conn,
                             boost::asio::buffer(in_idx,4),
-                            boost::bind(&session::on_recv_len,this,
+                            pump(_rx_ops,boost::bind(&session::on_recv_len,this,
                                 boost::asio::placeholders::error,
-                                boost::asio::placeholders::bytes_transferred));
+                                in_ch=='b')));
                         break;
                     case 'o':
                         boost::asio::async_read(
                             *conn,
                             boost::asio::buffer(in_idx,4),
-                            boost::bind(&session::on_recv_oref,this,
+                            pump(_rx_ops,boost::bind(&session::on_recv_oref,this,
                                 boost::asio::placeholders::error,
-                                boost::asio::placeholders::bytes_transferred));
+                                boost::asio::placeholders::bytes_transferred)));
                         break;
                     case ':':
                         boost::asio::async_read(
                             *conn,
                             boost::asio::buffer(in_idx,4),
-                            boost::bind(&session::on_recv_dmc_obid,this,
-                                boost::asio::placeholders::error));
+                            pump(_rx_ops,boost::bind(&session::on_recv_dmc_obid,this,
+                                boost::asio::placeholders::error)));
                         break;
                     case '.':
                         boost::asio::async_read(
                             *conn,
                             boost::asio::buffer(in_idx,4),
-                            boost::bind(&session::on_recv_call_obid,this,
-                                boost::asio::placeholders::error));
+                            pump(_rx_ops,boost::bind(&session::on_recv_call_obid,this,
+                                boost::asio::placeholders::error)));
                         break;
                     case '~':
                         boost::asio::async_read(
                             *conn,
                             boost::asio::buffer(in_idx,4),
-                            boost::bind(&session::on_recv_dead_obid,this,
-                                boost::asio::placeholders::error));
+                            pump(_rx_ops,boost::bind(&session::on_recv_dead_obid,this,
+                                boost::asio::placeholders::error)));
+                        break;
+                    case 'V':
+                        boost::asio::async_read(
+                            *conn,
+                            boost::asio::buffer(in_idx,4),
+                            pump(_rx_ops,boost::bind(&session::on_recv_version,this,
+                                boost::asio::placeholders::error)));
+                        break;
+                    case '{':
+                        /* remote sends only frames from here on */
+                        _framed_rx=true;
+                        /* busy until whole frame arrives */
+                        _opcode_read_queued=true;
+                        boost::asio::async_read(
+                            *conn,
+                            boost::asio::buffer(in_idx,4),
+                            pump(_rx_ops,boost::bind(&session::on_recv_frame_len,this,
+                                boost::asio::placeholders::error)));
                         break;
                     default:
-                        LOCK_COUT
-                        cout << "session [" << this << "] recv len="
+                        BVLOG_DEBUG("session [" << this << "] recv len="
                                   << rlen << " 0x"
-                                  << std::setw(2) << std::setfill('0') << std::hex << ich;
-                        if (ich>31 && ich<128)
-                            cout << ' ' << in_ch;
-                        cout << endl;
-                        UNLOCK_COUT
+                                  << std::setw(2) << std::setfill('0') << std::hex
+                                  << int((unsigned char)in_ch)
+                                  << (((unsigned char)in_ch>31 && (unsigned char)in_ch<128)?string(1,' ')+in_ch:string()));
                     }
                 }
             } else {
-                LOCK_COUT
                 if (_float_or_semi) {
-                    cout << "session [" << this
+                    BVLOG_INFO("session [" << this
                               << "] expected floatnum; got EOF"
-                              << " (" << ec << ")"
-                              << endl;
+                              << " (" << ec << ")");
 
                 } else {
-                    cout << "session [" << this
+                    BVLOG_INFO("session [" << this
                               << "] expected opcode got EOF"
-                              << " (" << ec << ")"
-                              << endl;
+                              << " (" << ec << ")");
                 }
-                UNLOCK_COUT
                 isActive=false;
             }
         }
     }
+    inline void session::recv_value(value &&val) {
+        ++stats.values_rx[val.type()];
+        argstack.push(std::move(val));
+        stats.argstack_hwm=std::max(stats.argstack_hwm,argstack.size());
+        check_argnotify();
+    }
+    inline void session::recv_oref(u32 idx) {
+        proxy[idx]=true;
+        if (isBooting) {
+            BVLOG_INFO("session [" << this
+                      << "] booted: remote root=" << idx);
+            remoteRoot=idx;
+            // booted once root known
+            isBooting=false;
+            ++stats.values_rx[vtObref];
+        } else {
+            recv_value(obref(idx));
+        }
+    }
+    inline void session::recv_dead(u32 obid) {
+        ++stats.values_rx[vtDeath];
+        /* proxy eliminates need for death messages in argstack */
+        proxy.erase(obid);
+        /* if there's a contract cached remove it also */
+        auto iface=contracts.find(obid);
+        if (iface!=contracts.end())
+            contracts.erase(obid);
+        BVLOG_DEBUG("session [" << this << "] recv ~" << obid);
+    }
+    inline void session::recv_call(u32 obid,u32 idx) {
+        ++stats.values_rx[vtMethod];
+        object *ob=reg->obOf(obid);
+        const string label=ob->methodLabel(idx);
+        BVLOG_DEBUG("Session [" << this << "] call "
+                  << ob->getType() << '[' << ob << "]." << label);
+        label_stats &ls=stats.methods[label];
+        u64 t0=stats_clock();
+        ob->methodCall(idx);
+        ++ls.calls_in;
+        ls.exec_ns+=stats_clock()-t0;
+    }
+    inline void session::recv_dmc(const dmc_msg &mk_dmc) {
+        ++stats.values_rx[vtDMC];
+        contracts[mk_dmc.ob][mk_dmc.label]=mk_dmc.slot;
+        BVLOG_DEBUG("session [" << this << "] recv dmc ("
+             << mk_dmc.ob << "." << mk_dmc.label
+             << "=" << mk_dmc.slot << ")");
+    }
+    inline void session::recv_version(u32 ver) {
+        ++stats.values_rx[vtVersion];
+        remoteVersion=ver;
+        /* both ends must understand frames before sending any */
+        _framed_tx=(getVersion()>=2);
+        BVLOG_DEBUG("session [" << this << "] remote protocol v" << ver
+             << (_framed_tx?" (framed)":""));
+    }
+
+    /** @brief pull LE uint32 out of a frame @throw bad_frame if truncated */
+    inline u32 frame_u32(const char *&p,const char *end) {
+        u32 v;
+        if (end-p<4) throw bad_frame();
+        memcpy(&v,p,4);
+        p+=4;
+        return v;
+    }
+
+    /** @brief valtype carried by a (non-sign) opcode, for statistics */
+    inline valtype opcode_type(char op) {
+        switch (op) {
+        case 'f':
+        case 'r': return vtFloat;
+        case 'd': return vtDouble;
+        case '"': return vtString;
+        case 'b': return vtBlob;
+        case 'o': return vtObref;
+        case ':': return vtDMC;
+        case '.': return vtMethod;
+        case '~': return vtDeath;
+        case 'V': return vtVersion;
+        default:  return vtInt;
+        }
+    }
+
+    inline void session::decode(const char *p,size_t len) {
+        /*
+        **  Frames arrive whole so unlike the stream handlers
+        **  this parser never waits on partially received values.
+        **  Anything running past the end of the frame is an error.
+        */
+        const char *end=p+len;
+        const char *item=p;
+        bool neg=false;
+        u64 t0=stats_clock();
+        while (p<end) {
+            char op=*p++;
+            switch (op) {
+            case '0':
+            case '1':
+            case '2':
+            case '3': {
+                    u32 bsize=pow2_tbl[op-'0'];
+                    if (u32(end-p)<bsize) throw bad_frame();
+                    u64 mag=0;
+                    memcpy(&mag,p,bsize);
+                    p+=bsize;
+                    s64 val=(s64)mag;
+                    if (neg) val=-val;
+                    neg=false;
+                    recv_value(val);
+                }
+                break;
+            case '-':
+                neg=true;
+                break;
+            case '+':
+                neg=false;
+                break;
+            case 'f': {
+                    const char *semi=(const char*)memchr(p,';',end-p);
+                    if (semi==NULL) throw bad_frame();
+                    float flt=0.0;
+                    std::istringstream cvt(string(p,semi));
+                    cvt >> flt;
+                    p=semi+1;
+                    recv_value(flt);
+                }
+                break;
+            case 'r': {
+                    if (end-p<4) throw bad_frame();
+                    float flt;
+                    memcpy(&flt,p,4);
+                    p+=4;
+                    recv_value(flt);
+                }
+                break;
+            case 'd': {
+                    if (end-p<8) throw bad_frame();
+                    double dbl;
+                    memcpy(&dbl,p,8);
+                    p+=8;
+                    recv_value(dbl);
+                }
+                break;
+            case '"': {
+                    u32 slen=frame_u32(p,end);
+                    if (u32(end-p)<slen) throw bad_frame();
+                    if (slen>string_max) throw value_too_large();
+                    recv_value(value(p,slen));
+                    p+=slen;
+                }
+                break;
+            case 'b': {
+                    /* blob refers into the frame, no copy */
+                    u32 slen=frame_u32(p,end);
+                    if (u32(end-p)<slen) throw bad_frame();
+                    recv_value(blob(in_frame,p,slen));
+                    p+=slen;
+                }
+                break;
+            case 'o':
+                recv_oref(frame_u32(p,end));
+                break;
+            case ':': {
+                    dmc_msg mk_dmc;
+                    mk_dmc.ob=frame_u32(p,end);
+                    u32 slen=frame_u32(p,end);
+                    if (u32(end-p)<slen) throw bad_frame();
+                    if (slen>label_max) throw value_too_large();
+                    mk_dmc.label.assign(p,slen);
+                    p+=slen;
+                    mk_dmc.slot=frame_u32(p,end);
+                    recv_dmc(mk_dmc);
+                }
+                break;
+            case '.': {
+                    u32 obid=frame_u32(p,end);
+                    recv_call(obid,frame_u32(p,end));
+                }
+                break;
+            case '~':
+                recv_dead(frame_u32(p,end));
+                break;
+            case 'V':
+                recv_version(frame_u32(p,end));
+                break;
+            default:
+                throw bad_frame();
+            }
+            if (op!='-' && op!='+') {
+                /* a sign is counted with the int it precedes */
+                stats.bytes_rx[opcode_type(op)]+=p-item;
+                item=p;
+            }
+        }
+        stats.decode_ns+=stats_clock()-t0;
+    }
+    inline void session::queue_read() {
+        if (_opcode_read_queued)
+            return;
+        _opcode_read_queued=true;
+        if (_framed_rx) {
+            /* opcode and length together since only frames will follow */
+            boost::array<boost::asio::mutable_buffer,2> hdr={{
+                boost::asio::buffer(&in_ch,1),
+                boost::asio::buffer(in_idx,4)
+            }};
+            boost::asio::async_read(
+                *conn,
+                hdr,
+                pump(_rx_ops,boost::bind(&session::on_recv_frame_hdr,this,
+                    boost::asio::placeholders::error)));
+        } else {
+            boost::asio::async_read(
+                *conn,
+                boost::asio::buffer(&in_ch,1),
+                pump(_rx_ops,boost::bind(&session::on_recv,this,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred)));
+        }
+    }
     inline void session::check_argnotify() {
         /**
         **  Notifies stored callback when argstack reaches specified size
@@ -1213,6 +2221,7 @@ namespace bvnet {
             if (args_avail>=argnotify.front().rcount) {
                 method_call mc(argnotify.front());
                 argnotify.pop();
+                stats.round_trip(mc);
                 mc.callbk();
             }
         }
@@ -1222,165 +2231,311 @@ namespace bvnet {
             if (isActive) {
                 if (io_->stopped())
                     io_->reset();
-                while (sendq.size()>0) {
-                    encode(sendq.front());
-                    sendq.pop();
-                }
-                if (!_opcode_read_queued) {
-                    _opcode_read_queued=true;
-                    boost::asio::async_read(
-                        *conn,
-                        boost::asio::buffer(&in_ch,1),
-                        boost::bind(&session::on_recv,this,
-                            boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
-                }
+                flush_sendq();
+                queue_read();
                 io_->run();
             }
         } catch (exception &e) {
             isActive=false;
-            LOCK_COUT
-            cout << "Session [" << this << "] closed: "
-                      << e.what() << endl;
-            UNLOCK_COUT
+            BVLOG_INFO("Session [" << this << "] closed: "
+                      << e.what());
             isActive=false;
         }
         return isActive;
     }
+    inline void session::start(boost::function<void()> closed) {
+        _pumped=true;
+        on_close=closed;
+        strand_->post(boost::bind(&session::after_handler,this));
+    }
+    inline void session::after_handler() {
+        if (isActive) {
+            try {
+                flush_sendq();
+                if (_rx_ops==0)
+                    queue_read();
+            } catch (exception &e) {
+                isActive=false;
+                BVLOG_INFO("Session [" << this << "] closed: " << e.what());
+            }
+        }
+        if (!isActive) {
+            if (!_closing) {
+                /* aborts whatever is still pending */
+                _closing=true;
+                boost::system::error_code ignored;
+                conn->close(ignored);
+                cancel_deadline();
+            }
+            if (_rx_ops+_tx_ops+_timer_ops==0 && on_close) {
+                boost::function<void()> closed;
+                closed.swap(on_close);
+                io_->post(closed);
+            }
+        }
+    }
+    inline void session::expire(boost::posix_time::time_duration after,boost::function<bool()> keep) {
+        if (deadline_==NULL)
+            deadline_=new boost::asio::deadline_timer(*io_);
+        deadline_->expires_from_now(after);
+        deadline_->async_wait(
+            pump(_timer_ops,boost::bind(&session::on_deadline,this,
+                boost::asio::placeholders::error,
+                keep)));
+    }
+    inline void session::on_deadline(const boost::system::error_code &ec,boost::function<bool()> keep) {
+        if (!ec && isActive && !keep()) {
+            BVLOG_INFO("Session [" << this << "] deadline passed (connection closed)");
+            isActive=false;
+            boost::system::error_code ignored;
+            conn->close(ignored);
+        }
+    }
+    inline void session::every(const string &key,boost::posix_time::time_duration period,boost::function<void()> tick) {
+        ticker &t=tickers_[key];
+        t.tick=tick;
+        t.period=period;
+        if (!t.tick) {
+            if (t.armed) {
+                boost::system::error_code ignored;
+                t.timer->cancel(ignored);
+                t.armed=false;
+            }
+            return;
+        }
+        if (t.timer==NULL)
+            t.timer=new boost::asio::deadline_timer(*io_);
+        // an armed ticker picks up the new period when it next fires
+        if (!t.armed)
+            arm_ticker(t);
+    }
+    inline void session::arm_ticker(ticker &t) {
+        t.armed=true;
+        t.timer->expires_from_now(t.period);
+        t.timer->async_wait(
+            pump(_timer_ops,boost::bind(&session::on_ticker,this,
+                boost::asio::placeholders::error,&t)));
+    }
+    inline void session::on_ticker(const boost::system::error_code &ec,ticker *t) {
+        // cancelled (or replaced by a newer wait, which owns armed)
+        if (ec)
+            return;
+        t->armed=false;
+        if (!isActive || !t->tick)
+            return;
+        t->tick();
+        if (!_pumped)
+            flush_sendq();
+        // tick() may have restarted (or stopped) its own ticker
+        if (isActive && t->tick && !t->armed)
+            arm_ticker(*t);
+    }
     inline bool session::poll() {
         try {
             if (isActive) {
                 if (io_->stopped())
                     io_->reset();
-                while (sendq.size()>0) {
-                    encode(sendq.front());
-                    sendq.pop();
-                }
-                if (!_opcode_read_queued) {
-                    _opcode_read_queued=true;
-                    boost::asio::async_read(
-                        *conn,
-                        boost::asio::buffer(&in_ch,1),
-                        boost::bind(&session::on_recv,this,
-                            boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
-                }
+                flush_sendq();
+                queue_read();
                 io_->poll();
             }
         } catch (exception &e) {
             isActive=false;
-            LOCK_COUT
-            cout << "Session " << this << " error: " << e.what()
-                      << " (connection closed)" << endl;
-            UNLOCK_COUT
+            BVLOG_INFO("Session " << this << " error: " << e.what()
+                      << " (connection closed)");
             isActive=false;
         }
         return isActive;
     }
-    inline void session::encode(const boost::any &raw) {
-        std::ostringstream ss;
-        u32 idx;
-        method_call mc(0,0,NULL,0);
-        dmc_msg v_dmc;
-        const char *idx_byte=(const char*)&idx;
-        type_map::iterator tmi=typeMap.find(raw.type().name());
-        if (tmi==typeMap.end()) {
-            LOCK_COUT
-            cout << "<unknown \"" << raw.type().name() << "\">" << endl;
-            UNLOCK_COUT
+    /** @brief append LE uint32 to outgoing buffer */
+    inline void put_u32(string &out,u32 v) {
+        out.append((const char*)&v,4);
+    }
+    inline void session::encode(const value &raw) {
+        /*
+        **  Appends the value to the session's outgoing buffer.
+        **  Nothing is written until the next flush.
+        */
+        size_t mark=tx_pending.size();
+        valtype vt=serialize(tx_pending,raw);
+        ++stats.values_tx[vt];
+        stats.bytes_tx[vt]+=tx_pending.size()-mark;
+        if (vt==vtMethod) {
+            arm_notify(raw.call());
+        }
+    }
+    inline void session::arm_notify(const method_call &mc) {
+        if (mc.callbk) {
+            // only if callback not null
+            if (mc.rcount==0) {
+                // a callback of rcount 0 notifies
+                // when the queued method call processed
+                mc.callbk();
+            } else {
+                // otherwise the notify is set for when
+                // argstack reaches size current_size+rcount
+                argnotify.push(mc);
+            }
+        }
+    }
+    inline void session::flush_sendq() {
+        if (sendq.size()==0) {
+            start_write();
+            return;
+        }
+        stats.sendq_hwm=std::max(stats.sendq_hwm,sendq.size());
+        u64 t0=stats_clock();
+        if (!_framed_tx) {
+            while (sendq.size()>0) {
+                encode(sendq.front());
+                sendq.pop();
+            }
         } else {
-            s64 val;
-            u64 mag,mag2;
-            int log2,bytes;
-            float flt;
-            switch (tmi->second) {
-            case vtInt:
-                val=boost::any_cast<s64>(raw);
-                mag=(val<0)?0-val:val;
-                if (val<0) {
-                    ss << '-';
-                }
-                bytes=1;
-                mag2=mag;
-                while (mag2>255) {
-                    ++bytes;
-                    mag2>>=8;
-                }
-                log2=log2_tbl[bytes-1];
-                ss << log2;
-                bytes=pow2_tbl[log2];
-                while (bytes>0) {
-                    ss << (const char)(mag&0xff);
-                    mag>>=8;
-                    --bytes;
+            /*
+            **  Everything queued goes out as frames of at most
+            **  frame_max payload bytes, split on value boundaries.
+            **  A value is encoded (and its call notify armed) only
+            **  once it is known to fit the current frame.
+            */
+            while (sendq.size()>0) {
+                size_t hdr=tx_pending.size();
+                tx_pending.append("{####",5);
+                while (sendq.size()>0) {
+                    size_t mark=tx_pending.size();
+                    const value &raw=sendq.front();
+                    valtype vt=serialize(tx_pending,raw);
+                    if (mark>hdr+5 && tx_pending.size()-hdr-5>frame_max) {
+                        tx_pending.resize(mark);
+                        break;
+                    }
+                    ++stats.values_tx[vt];
+                    stats.bytes_tx[vt]+=tx_pending.size()-mark;
+                    if (vt==vtMethod)
+                        arm_notify(raw.call());
+                    sendq.pop();
                 }
-                break;
-            case vtFloat:
-                flt=boost::any_cast<float>(raw);
-                ss << 'f' << flt << ';';
-                break;
-            case vtBlob:
-            case vtString:
-                idx=boost::any_cast<string>(raw).size();
-                ss << '"'
-                   << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3];
-                ss << boost::any_cast<string>(raw);
-                break;
-            case vtObref:
-                idx=boost::any_cast<obref>(raw).id;
-                ss << 'o'
-                   << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3];
-                break;
-            case vtDeath:
-                idx=boost::any_cast<ob_is_gone>(raw).id;
-                ss << '~'
-                   << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3];
-                break;
-            case vtDMC:
-                v_dmc=boost::any_cast<dmc_msg>(raw);
-                ss << ':';
-                idx=v_dmc.ob;
-                ss << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3];
-                idx=v_dmc.label.size();
-                ss << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3]
-                   << v_dmc.label;
-                idx=v_dmc.slot;
-                ss << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3];
-                break;
-            case vtMethod:
-                mc=boost::any_cast<method_call>(raw);
-                /*LOCK_COUT
-                cout << "call #" << mc.id << '.' << mc.idx
-                          << "() cb=" << mc.callbk
-                          << ", when stack+=" << mc.rcount
-                          << endl;
-                UNLOCK_COUT*/
-                ss << '.';
-                idx=mc.id;
-                ss << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3];
-                idx=mc.idx;
-                ss << idx_byte[0] << idx_byte[1] << idx_byte[2] << idx_byte[3];
-                break;
+                u32 len=tx_pending.size()-hdr-5;
+                memcpy(&tx_pending[hdr+1],&len,4);
+                ++stats.frames_tx;
             }
-            string *dynstr=new string(ss.str());
-            if (tmi->second==vtMethod
-                && mc.callbk) {
-                // only if callback not null
-                if (mc.rcount==0) {
-                    // a callback of rcount 0 notifies
-                    // when the queued method call processed
-                    mc.callbk();
-                } else {
-                    // otherwise the notify is set for when
-                    // argstack reaches size current_size+rcount
-                    argnotify.push(mc);
-                }
+        }
+        stats.encode_ns+=stats_clock()-t0;
+        start_write();
+    }
+    inline void session::start_write() {
+        /*
+        **  At most one write in flight.  Values encoded meanwhile
+        **  accumulate in tx_pending and go out when it completes.
+        **  The two buffers trade places so neither is reallocated
+        **  once grown to the session's working size.
+        */
+        if (_write_in_flight || tx_pending.size()==0)
+            return;
+        _write_in_flight=true;
+        tx_flight.swap(tx_pending);
+        tx_pending.clear();
+        boost::asio::async_write(
+            *conn,
+            boost::asio::buffer(tx_flight.data(),tx_flight.size()),
+                pump(_tx_ops,boost::bind(&session::on_write_done,this,
+                    boost::asio::placeholders::error)));
+    }
+    inline valtype session::serialize(string &out,const value &raw) {
+        s64 val;
+        u64 mag,mag2;
+        int log2,bytes;
+        char fpbuf[32];
+        switch (raw.type()) {
+        case vtInt:
+            val=raw.as<s64>();
+            mag=(val<0)?0-val:val;
+            if (val<0) {
+                out+='-';
             }
-            boost::asio::async_write(
-                *conn,
-                boost::asio::buffer(*dynstr,dynstr->size()),
-                    boost::bind(&session::on_write_done,this,dynstr));
+            bytes=1;
+            mag2=mag;
+            while (mag2>255) {
+                ++bytes;
+                mag2>>=8;
+            }
+            log2=log2_tbl[bytes-1];
+            out+=(char)('0'+log2);
+            bytes=pow2_tbl[log2];
+            while (bytes>0) {
+                out+=(char)(mag&0xff);
+                mag>>=8;
+                --bytes;
+            }
+            break;
+        case vtFloat:
+            if (getVersion()>=3) {
+                float flt=raw.as<float>();
+                out+='r';
+                out.append((const char*)&flt,4);
+            } else {
+                /* %g is what ostream << float produced */
+                snprintf(fpbuf,sizeof(fpbuf),"%g",(double)raw.as<float>());
+                out+='f';
+                out+=fpbuf;
+                out+=';';
+            }
+            break;
+        case vtDouble:
+            if (getVersion()>=3) {
+                double dbl=raw.as<double>();
+                out+='d';
+                out.append((const char*)&dbl,8);
+            } else {
+                /* older remotes only know text floats */
+                snprintf(fpbuf,sizeof(fpbuf),"%.17g",raw.as<double>());
+                out+='f';
+                out+=fpbuf;
+                out+=';';
+            }
+            break;
+        case vtBlob:
+            out+='b';
+            put_u32(out,raw.size());
+            out.append(raw.data(),raw.size());
+            break;
+        case vtString:
+            out+='"';
+            put_u32(out,raw.size());
+            out.append(raw.data(),raw.size());
+            break;
+        case vtObref:
+            out+='o';
+            put_u32(out,raw.id_of());
+            break;
+        case vtDeath:
+            out+='~';
+            put_u32(out,raw.id_of());
+            break;
+        case vtVersion:
+            out+='V';
+            put_u32(out,raw.id_of());
+            break;
+        case vtDMC: {
+                const dmc_msg &v_dmc=raw.dmc_of();
+                out+=':';
+                put_u32(out,v_dmc.ob);
+                put_u32(out,v_dmc.label.size());
+                out+=v_dmc.label;
+                put_u32(out,v_dmc.slot);
+            }
+            break;
+        case vtMethod: {
+                const method_call &mc=raw.call();
+                out+='.';
+                put_u32(out,mc.id);
+                put_u32(out,mc.idx);
+            }
+            break;
+        default:
+            BVLOG_DEBUG("<unknown valtype " << raw.type() << ">");
+            break;
         }
+        return raw.type();
     }
 
     inline void session::dump(std::ostream &os) {
@@ -1388,6 +2543,9 @@ namespace bvnet {
         os << "session object" << endl;
         os << "  argstack count: " << argstack.size() << endl;
         os << "  send queue size: " << sendq.size() << endl;
+        os << "  stats: ";
+        stats.write_json(os);
+        os << endl;
         os << "  socket: ";
         if (conn==NULL) {
             os << "<none>";
@@ -1402,15 +2560,20 @@ namespace bvnet {
     inline void registry::dump(std::ostream &os) {
         LOCK_COUT
         os << "  registry" << endl;
-        os << "    objects registered: " << objects.size() << endl;
-        object_map::iterator i=objects.begin();
+        os << "    objects registered: " << ids.size() << " of " << max_objects
+           << " (peak " << objects_peak << ")" << endl;
+        os << "    memory charged: " << mem_used << " of " << mem_budget
+           << " bytes (peak " << mem_peak << ")" << endl;
+        os << "    refused: " << refused << endl;
+        os << "    slots: " << slots.size() << " (" << vacant.size() << " vacant)" << endl;
         object *o;
-        while (i!=objects.end()) {
-            o=i->get<object_addr>();
-            os << "      refid=" << i->get<object_id>() << " [";
+        for (u32 idx=0;idx<slots.size();++idx) {
+            o=slots[idx].ob;
+            if (o==NULL)
+                continue;
+            os << "      refid=" << std::dec << ((slots[idx].gen<<reg_slot_bits)|(idx+1)) << " [";
             os << std::setfill('0') << std::setw(8) << std::hex << (u32)o;
-            os << "] type=" << o->getType() << endl;
-            ++i;
+            os << "] type=" << o->getType() << std::dec << endl;
         }
         UNLOCK_COUT
     }
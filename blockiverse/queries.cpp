@@ -144,6 +144,9 @@ namespace bvquery {
             ",Cy INTEGER NOT NULL"
             ",Cz INTEGER NOT NULL"
         ")",
+        /** @brief one chunk per position within an entity */
+        "CREATE UNIQUE INDEX IF NOT EXISTS ChunkRefPos "
+            "ON ChunkRef (entityId,Cx,Cy,Cz)",
 
         /** @brief Property definitions */
         "CREATE TABLE IF NOT EXISTS Property ("
@@ -169,58 +172,179 @@ namespace bvquery {
     };
 
     /** @brief Search for account owned by specified client (pubkey) */
-    const char *findOwner=
-        "SELECT "
-            "* "
-        "FROM "
-            "Owner "
-        "WHERE "
-            "userkey=?1";
+    const bvdb::query<std::tuple<string>,row::Owner> findOwner={
+            "SELECT "
+                "* "
+            "FROM "
+                "Owner "
+            "WHERE "
+                "userkey=?1"
+    };
 
     /** @brief Search for account using specified username */
-    const char *findUser=
-        "SELECT "
-            "* "
-        "FROM "
-            "Owner "
-        "WHERE "
-            "username=?1";
+    const bvdb::query<std::tuple<string>,row::Owner> findUser={
+            "SELECT "
+                "* "
+            "FROM "
+                "Owner "
+            "WHERE "
+                "username=?1"
+    };
 
     /** @brief Search for whitelist entry allowing access via specified client (pubkey) */
-    const char *findAllowed=
-        "SELECT "
-            "* "
-        "FROM "
-            "AllowedClient "
-        "WHERE "
-            "userid=?1 "
-            "AND allowkey=?2 "
-            "AND passwd=?3";
+    const bvdb::query<std::tuple<s64,string,string>,row::AllowedClient> findAllowed={
+            "SELECT "
+                "* "
+            "FROM "
+                "AllowedClient "
+            "WHERE "
+                "userid=?1 "
+                "AND allowkey=?2 "
+                "AND passwd=?3"
+    };
 
     /** @brief Create new account for specified username and client (pubkey) */
-    const char *createAccount=
-        "INSERT "
-            "INTO Owner "
-                "(username,userkey) "
-            "VALUES "
-                "(?1,?2)";
+    const bvdb::query<std::tuple<string,string> > createAccount={
+            "INSERT "
+                "INTO Owner "
+                    "(username,userkey) "
+                "VALUES "
+                    "(?1,?2)"
+    };
 
     /** @brief Logs user into account
     *   Catchable constraint error on attempt to login
     *   to the same account more than once. */
-    const char *loginAccount=
-        "INSERT "
-            "INTO LoggedIn "
-                "(userid) "
-            "VALUES "
-                "(?1)";
+    const bvdb::query<std::tuple<s64> > loginAccount={
+            "INSERT "
+                "INTO LoggedIn "
+                    "(userid) "
+                "VALUES "
+                    "(?1)"
+    };
 
     /** @brief Log user out of account */
-    const char *logoutAccount=
-        "DELETE "
+    const bvdb::query<std::tuple<s64> > logoutAccount={
+            "DELETE "
+                "FROM "
+                    "LoggedIn "
+                "WHERE "
+                    "userid=?1"
+    };
+
+    /** @brief Entity's pivot (0 if none) and chunk position */
+    const bvdb::query<std::tuple<s64>,row::findPlace> findPlace={
+            "SELECT "
+                "IFNULL(pivotId,0),Cx,Cy,Cz "
+            "FROM "
+                "Entity "
+            "WHERE "
+                "entityId=?1"
+    };
+
+    /** @brief Move entity to another chunk of its pivot */
+    const bvdb::query<std::tuple<s64,s64,s64,s64> > moveEntity={
+            "UPDATE "
+                "Entity "
+            "SET "
+                "Cx=?2,Cy=?3,Cz=?4 "
+            "WHERE "
+                "entityId=?1"
+    };
+
+    /** @brief Find chunk stored at position within entity */
+    const bvdb::query<std::tuple<s64,s64,s64,s64>,row::findChunkRef> findChunkRef={
+            "SELECT "
+                "chunkRefId,sha "
+            "FROM "
+                "ChunkRef "
+            "WHERE "
+                "entityId=?1 "
+                "AND Cx=?2 "
+                "AND Cy=?3 "
+                "AND Cz=?4"
+    };
+
+    /** @brief Load chunk data stored at position within entity */
+    const bvdb::query<std::tuple<s64,s64,s64,s64>,row::loadChunk> loadChunk={
+            "SELECT "
+                "Chunk.data "
             "FROM "
-                "LoggedIn "
+                "ChunkRef "
+                "JOIN Chunk ON Chunk.sha=ChunkRef.sha "
+            "WHERE "
+                "ChunkRef.entityId=?1 "
+                "AND ChunkRef.Cx=?2 "
+                "AND ChunkRef.Cy=?3 "
+                "AND ChunkRef.Cz=?4"
+    };
+
+    /** @brief Store chunk data unless identical data is already stored
+    *   Starts unreferenced; follow with refChunk */
+    const bvdb::query<std::tuple<string,bvdb::blob_ref> > storeChunk={
+            "INSERT OR IGNORE "
+                "INTO Chunk "
+                    "(sha,refcount,data) "
+                "VALUES "
+                    "(?1,0,?2)"
+    };
+
+    /** @brief Count one more reference to chunk data */
+    const bvdb::query<std::tuple<string> > refChunk={
+            "UPDATE "
+                "Chunk "
+            "SET "
+                "refcount=refcount+1 "
+            "WHERE "
+                "sha=?1"
+    };
+
+    /** @brief Count one less reference to chunk data */
+    const bvdb::query<std::tuple<string> > unrefChunk={
+            "UPDATE "
+                "Chunk "
+            "SET "
+                "refcount=refcount-1 "
             "WHERE "
-                "userid=?1";
+                "sha=?1"
+    };
+
+    /** @brief Remove chunk data once nothing references it */
+    const bvdb::query<std::tuple<string> > purgeChunk={
+            "DELETE "
+                "FROM "
+                    "Chunk "
+                "WHERE "
+                    "sha=?1 "
+                    "AND refcount<=0"
+    };
+
+    /** @brief Place chunk at position within entity */
+    const bvdb::query<std::tuple<s64,s64,s64,s64,string> > addChunkRef={
+            "INSERT "
+                "INTO ChunkRef "
+                    "(entityId,Cx,Cy,Cz,sha) "
+                "VALUES "
+                    "(?1,?2,?3,?4,?5)"
+    };
+
+    /** @brief Replace chunk at a stored position */
+    const bvdb::query<std::tuple<s64,string> > setChunkRef={
+            "UPDATE "
+                "ChunkRef "
+            "SET "
+                "sha=?2 "
+            "WHERE "
+                "chunkRefId=?1"
+    };
+
+    /** @brief Remove chunk from a stored position */
+    const bvdb::query<std::tuple<s64> > dropChunkRef={
+            "DELETE "
+                "FROM "
+                    "ChunkRef "
+                "WHERE "
+                    "chunkRefId=?1"
+    };
 
 };
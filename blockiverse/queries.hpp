@@ -20,7 +20,9 @@
 #define BV_QUERIES_HPP_INCLUDED
 
 #include <string>
+#include <tuple>
 #include <vector>
+#include "database.hpp"
 
 namespace bvquery {
 
@@ -117,6 +119,23 @@ namespace bvquery {
                 Value=2
             };
         };
+        namespace Chunk {
+            enum _schema {
+                sha=0,
+                refcount=1,
+                data=2
+            };
+        };
+        namespace ChunkRef {
+            enum _schema {
+                chunkRefId=0,
+                entityId=1,
+                sha=2,
+                Cx=3,
+                Cy=4,
+                Cz=5
+            };
+        };
     };
 
     namespace result {
@@ -129,25 +148,77 @@ namespace bvquery {
         namespace findAllowed {
             using namespace bvquery::table::AllowedClient;
         };
+        namespace findChunkRef {
+            enum _schema {
+                chunkRefId=0,
+                sha=1
+            };
+        };
+        namespace loadChunk {
+            enum _schema {
+                data=0
+            };
+        };
+        namespace findPlace {
+            enum _schema {
+                pivotId=0,
+                Cx=1,
+                Cy=2,
+                Cz=3
+            };
+        };
+    };
+
+    /** @brief Result rows of the typed queries (columns as in result) */
+    namespace row {
+        typedef std::tuple<s64,string,string> Owner;
+        typedef std::tuple<s64,string,string> AllowedClient;
+        typedef std::tuple<s64,s64,s64,s64> findPlace;
+        typedef std::tuple<s64,string> findChunkRef;
+        typedef std::tuple<string> loadChunk;
     };
 
     /** @brief Iterable for initializing all tables via loop */
     extern std::vector<const char *> init_tables;
 
     /** @brief Search for account owned by specified client (pubkey) */
-    extern const char *findOwner;
+    extern const bvdb::query<std::tuple<string>,row::Owner> findOwner;
     /** @brief Search for account using specified username */
-    extern const char *findUser;
+    extern const bvdb::query<std::tuple<string>,row::Owner> findUser;
     /** @brief Search for whitelist entry allowing access via specified client (pubkey) */
-    extern const char *findAllowed;
+    extern const bvdb::query<std::tuple<s64,string,string>,row::AllowedClient> findAllowed;
     /** @brief Create new account for specified username and client (pubkey) */
-    extern const char *createAccount;
+    extern const bvdb::query<std::tuple<string,string> > createAccount;
     /** @brief Logs user into account
     *   Catchable constraint error on attempt to login
     *   to the same account more than once. */
-    extern const char *loginAccount;
+    extern const bvdb::query<std::tuple<s64> > loginAccount;
     /** @brief Log user out of account */
-    extern const char *logoutAccount;
+    extern const bvdb::query<std::tuple<s64> > logoutAccount;
+
+    /** @brief Entity's pivot (0 if none) and chunk position */
+    extern const bvdb::query<std::tuple<s64>,row::findPlace> findPlace;
+    /** @brief Move entity to another chunk of its pivot */
+    extern const bvdb::query<std::tuple<s64,s64,s64,s64> > moveEntity;
+    /** @brief Find chunk stored at position within entity */
+    extern const bvdb::query<std::tuple<s64,s64,s64,s64>,row::findChunkRef> findChunkRef;
+    /** @brief Load chunk data stored at position within entity */
+    extern const bvdb::query<std::tuple<s64,s64,s64,s64>,row::loadChunk> loadChunk;
+    /** @brief Store chunk data unless identical data is already stored
+    *   Starts unreferenced; follow with refChunk */
+    extern const bvdb::query<std::tuple<string,bvdb::blob_ref> > storeChunk;
+    /** @brief Count one more reference to chunk data */
+    extern const bvdb::query<std::tuple<string> > refChunk;
+    /** @brief Count one less reference to chunk data */
+    extern const bvdb::query<std::tuple<string> > unrefChunk;
+    /** @brief Remove chunk data once nothing references it */
+    extern const bvdb::query<std::tuple<string> > purgeChunk;
+    /** @brief Place chunk at position within entity */
+    extern const bvdb::query<std::tuple<s64,s64,s64,s64,string> > addChunkRef;
+    /** @brief Replace chunk at a stored position */
+    extern const bvdb::query<std::tuple<s64,string> > setChunkRef;
+    /** @brief Remove chunk from a stored position */
+    extern const bvdb::query<std::tuple<s64> > dropChunkRef;
 
 };
 
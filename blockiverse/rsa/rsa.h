@@ -0,0 +1 @@
+/root/repo/blockiverse/rsa/RSA.h
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include <windows.h>
 #include <iostream>
 #include <map>
+#include <set>
 #include "sqlite/sqlite3.h"
 #include "protocol.hpp"
 #include "server.hpp"
@@ -58,12 +59,41 @@ using bv::Account;
 
 void server_default_config(Configurator &cfg) {
     cfg["port"]="37001";
+    // threads running the shared session io_service
+    // (auto: one per core, 0: a thread per connection)
+    cfg["io_threads"]="auto";
+    // admission control
+    cfg["max_sessions"]="256";
+    cfg["max_handshakes"]="32";         // sessions yet to authenticate
+    cfg["handshake_timeout"]="30";      // seconds to authenticate
+    cfg["ip_accepts_per_min"]="20";     // connections per address
+    // per client session limits on registered objects
+    cfg["session_max_objects"]="65536";
+    cfg["session_mem_budget"]="16777216";   // bytes
+    // per client session chunk streaming
+    cfg["stream_rate"]="262144";        // bytes per second
+    cfg["stream_tick_ms"]="100";
+    cfg["stream_dist"]="16";            // chunks each way from player
+    cfg["stream_edits"]="256";          // node edits accepted per tick
+    cfg["chunk_codec"]="lz";            // none, rle or lz
+    cfg["db_wal"]="1";                  // write-ahead log journal
+    cfg["db_busy_ms"]="5000";           // wait on a locked database this long
+    cfg["db_synchronous"]="NORMAL";     // OFF, NORMAL, FULL, EXTRA or 0-3
+    cfg["db_mmap_size"]="67108864";     // bytes of database memory mapped
+    cfg["db_retry_ms"]="30000";         // give up on a busy database after
+    cfg["db_write_ms"]="250";           // world saves collect this long per commit
+    cfg["db_write_batch"]="4096";       // or until this many are waiting
+    cfg["db_pool_size"]="16";           // connections shared by the sessions
+    cfg["db_pool_wait_ms"]="5000";      // wait for a free connection this long
+    cfg["db_pool_check_ms"]="60000";    // check connections idle longer before reuse
 }
 
 struct context {
     tcp::socket *socket;
     bvnet::session *session;
     bvnet::object *root;
+    bool handshaking;                   // yet to answer login challenge
+    boost::function<void()> finished;   // called as the context is destroyed
 };
 
 class context_manager {
@@ -80,6 +110,8 @@ class context_manager {
         ctx->socket->close();
         delete ctx->socket;
         ctx->socket=NULL;
+        if (ctx->finished)
+            ctx->finished();
         delete ctx;
         ctx=NULL;
     }
@@ -92,9 +124,7 @@ DWORD WINAPI server_boot(LPVOID lpvCtx) {
     context &ctx=*((context*)lpvCtx);   // make a proper reference
     context_manager raii_ctx(&ctx);     // proper cleanup on thread exit
 
-    LOCK_COUT
-    cout << "[server] session [" << ctx.session << "] slave on socket " << ctx.socket << endl;
-    UNLOCK_COUT
+    BVLOG_INFO("[server] session [" << ctx.session << "] slave on socket " << ctx.socket);
     //ctx.session->dump(cout);
 
     ctx.session->bootstrap(ctx.root);
@@ -103,9 +133,7 @@ DWORD WINAPI server_boot(LPVOID lpvCtx) {
         /* until session dies or server shutdown */
     }
 
-    LOCK_COUT
-    cout << "[server] slave for socket "<< ctx.socket << " finished." << endl;
-    UNLOCK_COUT
+    BVLOG_INFO("[server] slave for socket "<< ctx.socket << " finished.");
 
     return 0;
 }
@@ -113,6 +141,323 @@ DWORD WINAPI server_boot(LPVOID lpvCtx) {
 typedef std::map<boost::thread*,io_service*> s_list;
 s_list sessions;
 
+/*
+**  Sessions sharing the worker pool.  Added by the
+**  acceptor, removed by a worker once the session
+**  has closed.
+*/
+typedef std::set<context*> ctx_set;
+ctx_set pooled;
+boost::mutex pooled_lock;
+
+void pooled_closed(context *ctx) {
+    /*
+    ** called on a worker when a pooled session has
+    ** finished and none of its handlers remain queued
+    */
+    {
+        boost::mutex::scoped_lock lock(pooled_lock);
+        pooled.erase(ctx);
+    }
+    BVLOG_INFO("[server] session [" << ctx->session << "] on socket " << ctx->socket << " finished.");
+    context_manager raii_ctx(ctx);
+}
+
+void pool_worker(io_service *pool_io) {
+    /*
+    ** entry point for worker threads in pool mode.
+    ** Session handlers contain their own exceptions
+    ** so run() only returns once the pool is stopped.
+    */
+    pool_io->run();
+}
+
+/**
+*   @brief Accepts connections subject to admission control.
+*
+*   A connection is refused (closed straight away) when the
+*   server already has max_sessions sessions, when
+*   max_handshakes sessions have yet to answer the login
+*   challenge, or when its address has connected more than
+*   ip_accepts_per_min times in the current minute.  A session
+*   that has not answered the challenge within
+*   handshake_timeout seconds is dropped.
+*
+*   Accepting runs on the io_service of the listener which
+*   also polls req_serverQuit and stops once it is set.
+*/
+class admission {
+private:
+    /** @brief connections from one address in the current minute */
+    struct rate_window {
+        boost::posix_time::ptime start;
+        int count;
+    };
+    typedef std::map<boost::asio::ip::address,rate_window> rate_map;
+
+    tcp::acceptor &listener;
+    io_service &accept_io;          /**< @brief runs accepting (and pooled sessions) */
+    bool pool;                      /**< @brief sessions share accept_io */
+    boost::asio::deadline_timer tick;
+
+    int max_sessions;
+    int max_handshakes;
+    int ip_accepts_per_min;
+    boost::posix_time::time_duration handshake_timeout;
+    u32 session_max_objects;
+    size_t session_mem_budget;
+    bv::stream_limits streaming;
+    bv::ChunkEditor &edits;
+    bvdb::SQLitePool &connections;
+
+    boost::mutex lock;              /**< @brief guards the counters and rates */
+    int active;                     /**< @brief sessions admitted and not yet finished */
+    int handshakes;                 /**< @brief admitted sessions yet to authenticate */
+    rate_map rates;
+    bool accept_paused;             /**< @brief accepting resumes on the next tick */
+    bool accept_failing;            /**< @brief failure logged, no accept since */
+
+    io_service *next_io;            /**< @brief legacy mode: io_service of next socket */
+    tcp::socket *next_conn;         /**< @brief socket being accepted into */
+
+    static boost::posix_time::ptime now() {
+        return boost::posix_time::microsec_clock::universal_time();
+    }
+
+    /** @brief decide on a connection from addr @return reason for refusal or NULL */
+    const char *admit(const boost::asio::ip::address &addr) {
+        boost::mutex::scoped_lock hold(lock);
+        if (active>=max_sessions)
+            return "server full";
+        if (handshakes>=max_handshakes)
+            return "too many pending logins";
+        rate_window &rw=rates[addr];
+        boost::posix_time::ptime t=now();
+        if (rw.start.is_not_a_date_time() || t-rw.start>=boost::posix_time::minutes(1)) {
+            rw.start=t;
+            rw.count=0;
+        }
+        if (++rw.count>ip_accepts_per_min)
+            return "connecting too often";
+        ++active;
+        ++handshakes;
+        return NULL;
+    }
+
+    void accept_next() {
+        if (pool) {
+            next_io=NULL;
+            next_conn=new tcp::socket(accept_io);
+        } else {
+            next_io=new io_service;
+            next_conn=new tcp::socket(*next_io);
+        }
+        listener.async_accept(*next_conn,
+            boost::bind(&admission::on_accept,this,
+                boost::asio::placeholders::error));
+    }
+
+    /** @brief accept error that only concerns the connection that failed */
+    static bool transient(const boost::system::error_code &ec) {
+        return ec==boost::asio::error::connection_aborted
+            || ec==boost::asio::error::connection_reset
+            || ec==boost::asio::error::interrupted
+            || ec==boost::asio::error::try_again
+            || ec==boost::asio::error::would_block;
+    }
+
+    void on_accept(const boost::system::error_code &ec) {
+        tcp::socket *new_conn=next_conn;
+        io_service *s_chld_sess_io=next_io;
+        next_conn=NULL;
+        next_io=NULL;
+        if (ec==boost::asio::error::operation_aborted) {
+            // listener closed for shutdown
+            delete new_conn;
+            delete s_chld_sess_io;
+            return;
+        }
+        if (ec && !transient(ec)) {
+            // out of descriptors or buffers: accepting again at
+            // once would fail the same way, so wait for a tick
+            delete new_conn;
+            delete s_chld_sess_io;
+            boost::mutex::scoped_lock hold(lock);
+            if (!accept_failing)
+                BVLOG_WARN("[server] accept failed, retrying each tick: " << ec.message());
+            accept_failing=true;
+            accept_paused=true;
+            return;
+        }
+        if (!ec) {
+            boost::mutex::scoped_lock hold(lock);
+            if (accept_failing)
+                BVLOG_INFO("[server] accepting again");
+            accept_failing=false;
+        }
+        const char *refusal="accept failed";
+        boost::system::error_code ep_ec;
+        tcp::endpoint peer;
+        if (!ec) {
+            peer=new_conn->remote_endpoint(ep_ec);
+            if (!ep_ec)
+                refusal=admit(peer.address());
+        }
+        if (refusal!=NULL) {
+            BVLOG_INFO("[server] refused connection from " << peer
+                 << ": " << refusal);
+            boost::system::error_code ignored;
+            new_conn->close(ignored);
+            delete new_conn;
+            delete s_chld_sess_io;
+        } else {
+            launch(new_conn,s_chld_sess_io);
+        }
+        accept_next();
+    }
+
+    void launch(tcp::socket *new_conn,io_service *s_chld_sess_io) {
+        // create context object
+        context *ctx=new context;
+        // store socket in context
+        ctx->socket=new_conn;
+        // create new session in context
+        ctx->session=new bvnet::session();
+        // link connection socket to new session
+        ctx->session->set_conn(*new_conn);
+        ctx->session->set_object_limits(session_max_objects,session_mem_budget);
+        // create session's serverRoot object
+        // which is also stored in the context
+        serverRoot *root=new serverRoot(*ctx->session);
+        ctx->root=root;
+        root->streaming=streaming;
+        root->edits=&edits;
+        root->writes=&edits.writes();
+        root->connections=&connections;
+        ctx->finished=boost::bind(&admission::finished,this,ctx);
+        ctx->handshaking=true;
+        root->on_valid=boost::bind(&admission::authenticated,this,ctx);
+        // no handler of the session can be running yet
+        ctx->session->expire(handshake_timeout,
+            boost::bind(&serverRoot::isValid,root));
+        if (pool) {
+            BVLOG_INFO("[server] session [" << ctx->session << "] pooled on socket " << ctx->socket);
+            {
+                boost::mutex::scoped_lock hold(pooled_lock);
+                pooled.insert(ctx);
+            }
+            ctx->session->bootstrap(ctx->root);
+            ctx->session->start(boost::bind(pooled_closed,ctx));
+        } else {
+            // the worker thread manages the context
+            boost::thread *thd=new boost::thread(server_boot,ctx);
+            // to keep track of threads
+            sessions[thd]=s_chld_sess_io;
+        }
+    }
+
+    void on_tick(const boost::system::error_code &ec) {
+        if (ec)
+            return;
+        if (req_serverQuit) {
+            boost::system::error_code ignored;
+            listener.close(ignored);
+            accept_io.stop();
+            return;
+        }
+        {
+            // forget addresses whose window has passed
+            boost::mutex::scoped_lock hold(lock);
+            boost::posix_time::ptime t=now();
+            rate_map::iterator r=rates.begin();
+            while (r!=rates.end()) {
+                if (t-r->second.start>=boost::posix_time::minutes(1))
+                    rates.erase(r++);
+                else
+                    ++r;
+            }
+        }
+        bool resume;
+        {
+            boost::mutex::scoped_lock hold(lock);
+            resume=accept_paused;
+            accept_paused=false;
+        }
+        if (resume)
+            accept_next();
+        if (!pool) {
+            /*
+            ** Prune any completed session threads
+            */
+            s_list::iterator sThread=sessions.begin();
+            while (sThread!=sessions.end()) {
+                if (sThread->first->timed_join(boost::posix_time::seconds(0))) {
+                    delete sThread->first;  // delete thread
+                    delete sThread->second; // delete thread's io_service
+                    sessions.erase(sThread++);
+                } else {
+                    ++sThread;
+                }
+            }
+        }
+        arm_tick();
+    }
+
+    void arm_tick() {
+        tick.expires_from_now(boost::posix_time::milliseconds(250));
+        tick.async_wait(boost::bind(&admission::on_tick,this,
+            boost::asio::placeholders::error));
+    }
+
+public:
+    admission(tcp::acceptor &l,io_service &io,bool pooled_sessions,Configurator &cfg,
+              bv::ChunkEditor &world,bvdb::SQLitePool &dbPool)
+        : listener(l),accept_io(io),pool(pooled_sessions),tick(io),edits(world),connections(dbPool) {
+        max_sessions=v2int(cfg["max_sessions"]);
+        max_handshakes=v2int(cfg["max_handshakes"]);
+        ip_accepts_per_min=v2int(cfg["ip_accepts_per_min"]);
+        handshake_timeout=boost::posix_time::seconds(v2int(cfg["handshake_timeout"]));
+        session_max_objects=v2num<u32>(cfg,"session_max_objects",1);
+        session_mem_budget=v2num<size_t>(cfg,"session_mem_budget",1);
+        streaming.bytes_per_sec=v2num<size_t>(cfg,"stream_rate",1);
+        streaming.tick_ms=std::max(1,v2int(cfg["stream_tick_ms"]));
+        streaming.dist=v2int(cfg["stream_dist"]);
+        streaming.edits=std::max(0,v2int(cfg["stream_edits"]));
+        active=0;
+        handshakes=0;
+        accept_paused=false;
+        accept_failing=false;
+        next_io=NULL;
+        next_conn=NULL;
+    }
+    ~admission() {
+        delete next_conn;
+        delete next_io;
+    }
+
+    /** @brief begin accepting (and polling for shutdown) on the io_service */
+    void start() {
+        accept_next();
+        arm_tick();
+    }
+
+    /** @brief session answered the login challenge */
+    void authenticated(context *ctx) {
+        boost::mutex::scoped_lock hold(lock);
+        if (ctx->handshaking) {
+            ctx->handshaking=false;
+            --handshakes;
+        }
+    }
+
+    /** @brief session gone */
+    void finished(context *ctx) {
+        authenticated(ctx);
+        boost::mutex::scoped_lock hold(lock);
+        --active;
+    }
+};
+
 DWORD WINAPI server_main(LPVOID argvoid) {
     int argc=0;
     char **argv=NULL;
@@ -137,11 +482,51 @@ DWORD WINAPI server_main(LPVOID argvoid) {
     }*/
     UNLOCK_COUT
 
-    bvdb::init_db((cwd/"bv_db").string());
+    bvdb::db_tuning tuning;
+    tuning.wal=(v2int(server_config["db_wal"])!=0);
+    tuning.busy_ms=std::max(0,v2int(server_config["db_busy_ms"]));
+    tuning.synchronous=server_config["db_synchronous"];
+    tuning.retry_deadline_ms=std::max(0,v2int(server_config["db_retry_ms"]));
+    try {
+        tuning.mmap_size=v2num<s64>(server_config,"db_mmap_size");
+        bvdb::init_db((cwd/"bv_db").string(),tuning);
+    } catch (bad_setting &e) {
+        LOCK_COUT
+        cout << "[DB] Error in settings:" << endl
+                  << "     " << e.what()       << endl;
+        UNLOCK_COUT
+        serverActive=false;
+        return 1;
+    } catch (DBError &e) {
+        LOCK_COUT
+        cout << "[DB] Error opening database:" << endl
+                  << "     " << e.what()       << endl;
+        UNLOCK_COUT
+        serverActive=false;
+        return 1;
+    }
     try {
         SQLiteDB db;    // RAII
-        for (auto query : bvquery::init_tables)
-            db.runOnce(query);
+        boost::posix_time::ptime start=boost::posix_time::microsec_clock::universal_time();
+        // one transaction rather than a sync per table
+        db.runOnce("BEGIN IMMEDIATE");
+        try {
+            for (auto query : bvquery::init_tables)
+                db.runOnce(query);
+            db.runOnce("COMMIT");
+        } catch (DBError &e) {
+            try {
+                db.runOnce("ROLLBACK");
+            } catch (DBError &ignored) {
+                // a failed statement may already have ended it
+            }
+            throw;
+        }
+        LOCK_COUT
+        cout << "[DB] " << bvquery::init_tables.size() << " table statements in "
+             << (boost::posix_time::microsec_clock::universal_time()-start).total_milliseconds()
+             << "ms" << endl;
+        UNLOCK_COUT
     } catch (DBError &e) {
         LOCK_COUT
         cout << "[DB] Error creating tables:" << endl
@@ -158,70 +543,107 @@ DWORD WINAPI server_main(LPVOID argvoid) {
         UNLOCK_COUT
     }
 
-    io_service acceptor_io;
     int port=v2int(server_config["port"]);
+    int io_threads;
+    if (server_config["io_threads"]=="auto") {
+        io_threads=std::max(1u,boost::thread::hardware_concurrency());
+    } else {
+        io_threads=v2int(server_config["io_threads"]);
+    }
+    /*
+    ** pool mode: listener and sessions share server_io
+    ** io_threads=0: listener alone on server_io (this
+    **               thread) and a thread per connection
+    */
+    io_service server_io;
     LOCK_COUT
     cout << "[server] listening on port " << port
-              << " (io=" << &acceptor_io << ")"<< endl;
+              << " (io=" << &server_io << ")"<< endl;
     UNLOCK_COUT
-    tcp::acceptor listener(acceptor_io,tcp::endpoint(tcp::v4(),port));
-    serverReady=true;
-
-    while (!req_serverQuit) {
-        io_service *s_chld_sess_io=new io_service;
-        tcp::socket* new_conn=new tcp::socket(*s_chld_sess_io);
-        listener.accept(*new_conn);
+    tcp::acceptor listener(server_io,tcp::endpoint(tcp::v4(),port));
+    const bvmap::ChunkCodec *codec=bvmap::findCodec(server_config["chunk_codec"]);
+    if (codec==NULL) {
+        BVLOG_WARN("[server] unknown chunk_codec " << server_config["chunk_codec"] << ", using lz");
+        codec=bvmap::findCodec(bvmap::codec_lz);
+    }
+    bv::DBWriter writes(codec->id(),
+        boost::posix_time::milliseconds(std::max(1,v2int(server_config["db_write_ms"]))),
+        std::max(1,v2int(server_config["db_write_batch"])));
+    writes.start();
+    // chunk edits are applied together once per streaming tick
+    bv::ChunkEditor edits(writes);
+    edits.start(server_io,boost::posix_time::milliseconds(
+        std::max(1,v2int(server_config["stream_tick_ms"]))));
+    // sessions borrow these so a connecting client opens nothing
+    bvdb::SQLitePool connections(std::max(1,v2int(server_config["db_pool_size"])),
+        boost::posix_time::milliseconds(std::max(0,v2int(server_config["db_pool_wait_ms"]))),
+        boost::posix_time::milliseconds(std::max(0,v2int(server_config["db_pool_check_ms"]))));
+    int status=0;
+    try {
+        admission gate(listener,server_io,io_threads>0,server_config,edits,connections);
+        gate.start();
+        serverReady=true;
 
-        // create context object
-        context *ctx=new context;
-        // store socket in context
-        ctx->socket=new_conn;
-        // create new session in context
-        ctx->session=new bvnet::session();
-        // link connection socket to new session
-        ctx->session->set_conn(*new_conn);
-        // create session's serverRoot object
-        // which is also stored in the context
-        ctx->root=new serverRoot(*ctx->session);
-        // the worker thread manages the context
-        boost::thread *thd=new boost::thread(server_boot,ctx);
-        if (thd!=NULL) {
-            // to keep track of threads
-            sessions[thd]=s_chld_sess_io;
+        if (io_threads>0) {
+            LOCK_COUT
+            cout << "[server] " << io_threads << " session worker thread(s)" << endl;
+            UNLOCK_COUT
+            {
+                io_service::work keep_running(server_io);
+                boost::thread_group workers;
+                for (int i=0;i<io_threads;++i)
+                    workers.create_thread(boost::bind(pool_worker,&server_io));
+                // stopped by gate once req_serverQuit is seen
+                workers.join_all();
+            }
+            // workers gone so nothing else touches these
+            ctx_set remaining;
+            remaining.swap(pooled);
+            for (auto ctx : remaining) {
+                context_manager raii_ctx(ctx);
+            }
         } else {
-            // TODO: error
-        }
+            // stopped by gate once req_serverQuit is seen
+            server_io.run();
 
-        /*
-        ** Prune any completed session threads
-        */
-        s_list::iterator sThread=sessions.begin();
-        while (sThread!=sessions.end()) {
-            if (sThread->first->timed_join(boost::posix_time::seconds(0))) {
-                delete sThread->first;  // delete thread
-                delete sThread->second; // delete thread's io_service
+            // cleanly quit open sessions
+            s_list::iterator sThread=sessions.begin();
+            while (sThread!=sessions.end()) {
+                sThread->second->stop();        // make thread's io_service stop
+                sThread->first->join();         // wait for it to quit
+                delete sThread->first;          // delete thread
+                delete sThread->second;         // delete thread's io_service
                 sessions.erase(sThread++);
-            } else {
-                ++sThread;
             }
         }
+    } catch (bad_setting &e) {
+        LOCK_COUT
+        cout << "[server] Error in settings:" << endl
+                  << "     " << e.what()       << endl;
+        UNLOCK_COUT
+        status=1;
     }
-
-    // cleanly quit open sessions
-    s_list::iterator sThread=sessions.begin();
-    while (sThread!=sessions.end()) {
-        sThread->second->stop();        // make thread's io_service stop
-        sThread->first->join();         // wait for it to quit
-        delete sThread->first;          // delete thread
-        delete sThread->second;         // delete thread's io_service
-        sessions.erase(sThread++);
-    }
+    // sessions are gone so this is the last of the edits
+    // and the writes (logouts included)
+    edits.stop();
+    edits.flush();
+    writes.stop();
+    BVLOG_INFO("[server] world writes: " << writes.submittedCount() << " submitted, "
+               << writes.coalescedCount() << " coalesced, " << writes.batchCount() << " batches, "
+               << writes.droppedCount() << " dropped");
+    BVLOG_INFO("[server] db connections: " << connections.openedCount() << " opened, "
+               << connections.reusedCount() << " reused, " << connections.waitedCount() << " waited, "
+               << connections.timeoutCount() << " timed out, " << connections.missedCount() << " busy, "
+               << connections.discardedCount() << " discarded");
+    for (auto &b : SQLiteDB::busyStats())
+        BVLOG_INFO("[DB] busy " << b.second.busy << "x (" << (b.second.waited_us/1000) << "ms backing off, "
+                   << b.second.timeouts << " timeouts): " << b.first);
 
     LOCK_COUT
     cout << "[server] shutdown complete." << endl;
     UNLOCK_COUT
     serverActive=false;
-    return 0;
+    return status;
 }
 
 void serverRoot::dmc_LoginClient(value_queue &vqueue) {
@@ -289,6 +711,8 @@ void serverRoot::dmc_AnswerChallenge(value_queue &vqueue) {
     if (hChal==answer) {
         authOk=1;
         clientValid=true;
+        if (on_valid)
+            on_valid();
     }
     vqueue.push(authOk);
     if (!clientValid) {
@@ -344,10 +768,7 @@ void serverRoot::dmc_GetAccount(value_queue &vqueue) {
     // LIFO is password
     pass=RSA::Decrypt(ctx.getarg<string>(),*clientKey);
     user=ctx.getarg<string>();
-    LOCK_COUT
-    cout << "[server] request login for user " << user << endl;
-    //cout << "         password " << pass << endl;
-    UNLOCK_COUT
+    BVLOG_INFO("[server] request login for user " << user);
 
     if (clientValid) {
         std::ostringstream key;
@@ -355,7 +776,7 @@ void serverRoot::dmc_GetAccount(value_queue &vqueue) {
         // the client public key exponent in the current RSA lib
         // is always 65537 but future/forked clients might use differing
         // exponents so it needs to be saved.
-        bool try_again,authOK=false;
+        bool authOK=false;
         /*
         ** Access database for existing user account.
         ** Create (login suceeds) if does not exist
@@ -372,42 +793,21 @@ void serverRoot::dmc_GetAccount(value_queue &vqueue) {
         **/
         s64 IdOfOwner=-1;
         s64 IdOfUsername=-1;
+        bvdb::SQLitePool::lease conn=connections->acquire();
+        SQLiteDB &db=*conn;
         // see if account exists for this owner
         retry_login:
         authOK=false;
-        statement findOwner=db.prepare(bvquery::findOwner);
-        db.bind(findOwner,1,key.str());
-        query_result rsltOwner;
-        do {
-            try_again=false;
-            try {
-                rsltOwner=db.run(findOwner);
-            } catch (DBIsBusy &busy) {
-                try_again=true;
-            }
-        } while (try_again);
-        if (rsltOwner->size()>0)
-            IdOfOwner=db.get_result<s64>(rsltOwner,0,bvquery::result::findOwner::userid);
+        bvquery::row::Owner rsltOwner;
+        if (db.fetch(bvquery::findOwner,rsltOwner,key.str()))
+            IdOfOwner=std::get<bvquery::result::findOwner::userid>(rsltOwner);
 
         // see if account exists for this username
-        statement findUser=db.prepare(bvquery::findUser);
-        db.bind(findUser,1,user);
-        query_result rsltUser;
-        do {
-            try_again=false;
-            try {
-                rsltUser=db.run(findUser);
-            } catch (DBIsBusy &busy) {
-                try_again=true;
-            }
-        } while (try_again);
-        if (rsltUser->size()>0)
-            IdOfUsername=db.get_result<s64>(rsltUser,0,bvquery::result::findUser::userid);
+        bvquery::row::Owner rsltUser;
+        if (db.fetch(bvquery::findUser,rsltUser,user))
+            IdOfUsername=std::get<bvquery::result::findUser::userid>(rsltUser);
 
-        LOCK_COUT
-        cout << "rsltOwner " << rsltOwner;
-        cout << "rsltUser " << rsltUser;
-        UNLOCK_COUT
+        BVLOG_DEBUG("IdOfOwner " << IdOfOwner << " IdOfUsername " << IdOfUsername);
 
         if ((IdOfOwner<0)&&(IdOfUsername<0)) {
             // client has no account and username is unused
@@ -415,27 +815,14 @@ void serverRoot::dmc_GetAccount(value_queue &vqueue) {
             // goto retries the login.  This allows simpler error
             // checking on the INSERT query and allows using the
             // normal autocommit semantics.
-            statement createAccount=db.prepare(bvquery::createAccount);
-            db.bind(createAccount,1,user);
-            db.bind(createAccount,2,key.str());
-            query_result dontcare;
             bool insert_ok=false;
             try {
-                do {
-                    try_again=false;
-                    try {
-                        dontcare=db.run(createAccount);
-                    } catch (DBIsBusy &busy) {
-                        try_again=true;
-                    }
-                } while (try_again);
+                db.perform(bvquery::createAccount,user,key.str());
                 insert_ok=true;
             } catch (DBError &e) {
-                LOCK_COUT
-                cout << "[DB] Failed to create account for " << user
-                     << " via " << key.str() << " due to:" << endl
-                     << "     " << e.what() << endl;
-                UNLOCK_COUT
+                BVLOG_WARN("[DB] Failed to create account for " << user
+                     << " via " << key.str() << " due to:" << '\n'
+                     << "     " << e.what());
             }
             if (insert_ok) {
                 // retry the login as we don't yet know the auto column's userid
@@ -459,28 +846,22 @@ void serverRoot::dmc_GetAccount(value_queue &vqueue) {
                 // userid of owner matches userid of username
                 // action: login succeeds
                 try {
-                    bvnet::session::shared acct=ctx.get_shared(new Account(ctx,this,IdOfOwner));
+                    bvnet::session::shared acct=ctx.get_shared(new Account(ctx,this,IdOfOwner,db));
                     auto &obLval=*acct;
                     u32 acctId=ctx.getIdOf(&obLval);
-                    LOCK_COUT
-                    cout << "[server] Account login " << user << " on session "
-                         << &ctx <<  " objectid=" << acctId << endl;
-                    UNLOCK_COUT
+                    BVLOG_INFO("[server] Account login " << user << " on session "
+                         << &ctx <<  " objectid=" << acctId);
                     vqueue.push(bvnet::obref(acctId));
                     authOK=true;
                 } catch (DBError &e) {
-                    LOCK_COUT
-                    cout << "[server] Account (userid=" << IdOfOwner
-                         << ") login failed: " << e.what() << endl;
-                    UNLOCK_COUT
+                    BVLOG_WARN("[server] Account (userid=" << IdOfOwner
+                         << ") login failed: " << e.what());
                     authOK=false;
                 }
             } else {
                 if (IdOfUsername>=0) {
-                    LOCK_COUT
-                    cout << "[server] session " << &(this->ctx) << ": Account "
-                         << user << " belongs to someone else." << endl;
-                    UNLOCK_COUT
+                    BVLOG_INFO("[server] session " << &(this->ctx) << ": Account "
+                         << user << " belongs to someone else.");
                     // This is the attempt to log in as
                     // an existing username via a client
                     // (pubkey) that does not own the account
@@ -499,50 +880,32 @@ void serverRoot::dmc_GetAccount(value_queue &vqueue) {
                         hPass << std::setfill('0') << std::setw(2) << std::hex
                               << (unsigned int)dig[i];
                     free(dig);
-                    statement findAllowed=db.prepare(bvquery::findAllowed);
-                    db.bind(findAllowed,1,IdOfUsername);
-                    db.bind(findAllowed,2,key.str());
-                    db.bind(findAllowed,3,hPass.str());
-                    query_result rsltAllowed;
-                    do {
-                        try_again=false;
-                        try {
-                            rsltAllowed=db.run(findUser);
-                        } catch (DBIsBusy &busy) {
-                            try_again=true;
-                        }
-                    } while (try_again);
-                    if (rsltAllowed->size()>0) {
+                    bvquery::row::AllowedClient rsltAllowed;
+                    if (db.fetch(bvquery::findAllowed,rsltAllowed,IdOfUsername,key.str(),hPass.str())) {
                         s64 IdOfOtherOwner;
-                        IdOfOtherOwner=db.get_result<s64>(rsltAllowed,0,bvquery::result::findAllowed::userid);
+                        IdOfOtherOwner=std::get<bvquery::result::findAllowed::userid>(rsltAllowed);
                         // a result row indicates whitelist had
                         // an allowance entry for this client's pubkey
                         // and that the passwords matched up
                         try {
-                            bvnet::session::shared acct=ctx.get_shared(new Account(ctx,this,IdOfOtherOwner));
+                            bvnet::session::shared acct=ctx.get_shared(new Account(ctx,this,IdOfOtherOwner,db));
                             auto &obLval=*acct;
                             u32 acctId=ctx.getIdOf(&obLval);
-                            LOCK_COUT
-                            cout << "[server] Account login " << user << " on session "
-                                 << &ctx <<  " objectid=" << acctId << endl;
-                            UNLOCK_COUT
+                            BVLOG_INFO("[server] Account login " << user << " on session "
+                                 << &ctx <<  " objectid=" << acctId);
                             vqueue.push(bvnet::obref(acctId));
                             authOK=true;
                         } catch (DBError &e) {
                             // typically an attmept to login same account twice
-                            LOCK_COUT
-                            cout << "[server] Account (userid=" << IdOfOtherOwner
-                                 << ") login failed: " << e.what() << endl;
-                            UNLOCK_COUT
+                            BVLOG_WARN("[server] Account (userid=" << IdOfOtherOwner
+                                 << ") login failed: " << e.what());
                             authOK=false;
                         }
                     }
                 } else {
-                    LOCK_COUT
-                    cout << "[server] session " << &(this->ctx)
+                    BVLOG_INFO("[server] session " << &(this->ctx)
                          << ": attempt to create 2nd account "
-                         << user << endl;
-                    UNLOCK_COUT
+                         << user);
                     // this would be the case of creating
                     // a new account (username not in use)
                     // by a client (pubkey) already posessing
@@ -564,3 +927,24 @@ void serverRoot::dmc_GetAccount(value_queue &vqueue) {
         ctx.disconnect();
     }
 }
+
+void serverRoot::dmc_GetStats(value_queue &vqueue) {
+    /*
+    **  in: nothing
+    **
+    ** out: string: protocol statistics of this session (JSON)
+    **              (empty for an unauthorized client, which
+    **              is disconnected)
+    **
+    ** See bvnet::session_stats for the fields.
+    */
+    if (!clientValid) {
+        // invalid (unauthorized) client
+        vqueue.push(string());
+        ctx.disconnect();
+        return;
+    }
+    std::ostringstream json;
+    ctx.getStats().write_json(json);
+    vqueue.push(json.str());
+}
@@ -23,6 +23,8 @@
 #include <windows.h>
 #include "protocol.hpp"
 #include "database.hpp"
+#include "dbpool.hpp"
+#include "chunkstream.hpp"
 #include "sha1.hpp"
 #include <boost/nondet_random.hpp>
 
@@ -47,20 +49,34 @@ private:
     Key *clientKey;
     bool clientValid;
     string challenge;
-    SQLiteDB db;
     unsigned int randbits[8];
 protected:
     void dmc_LoginClient(value_queue &vqueue);
     void dmc_AnswerChallenge(value_queue &vqueue);
     void dmc_GetAccount(value_queue &vqueue);
+    void dmc_GetStats(value_queue &vqueue);
 public:
-    SQLiteDB &get_db() {return db;}
+    /** @brief called once the client has answered the challenge */
+    boost::function<void()> on_valid;
+    /** @brief chunk streaming limits for the session's account */
+    bv::stream_limits streaming;
+    /** @brief server-wide chunk edits */
+    bv::ChunkEditor *edits;
+    /** @brief world saves off the session threads */
+    bv::DBWriter *writes;
+    /** @brief server-wide connections (borrowed per call) */
+    bvdb::SQLitePool *connections;
+
+    /** @brief client has answered the challenge */
+    bool isValid() {return clientValid;}
 
     serverRoot(bvnet::session &sess)
-        : bvnet::object(sess) {
+        : bvnet::object(sess),edits(NULL),writes(NULL),connections(NULL) {
         register_dmc("LoginClient"      ,(dmc)&serverRoot::dmc_LoginClient);
         register_dmc("AnswerChallenge"  ,(dmc)&serverRoot::dmc_AnswerChallenge);
         register_dmc("GetAccount"       ,(dmc)&serverRoot::dmc_GetAccount);
+        register_dmc("GetStats"         ,(dmc)&serverRoot::dmc_GetStats);
+        charge(sizeof(serverRoot)-sizeof(bvnet::object));
         clientValid=false;
         challenge="";
         clientKey=NULL;
@@ -68,9 +84,7 @@ public:
     virtual ~serverRoot() {
         if (clientKey!=NULL)
             delete clientKey;
-        LOCK_COUT
-        cout << "serverRoot [" << this << "] gone (via session " << &ctx << ')' << endl;
-        UNLOCK_COUT
+        BVLOG_DEBUG("serverRoot [" << this << "] gone (via session " << &ctx << ')');
     }
 
     virtual const char *getType() {return "serverRoot";}
@@ -20,9 +20,6 @@
 
 int main(int argc, char** argv)
 {
-    extern void protocol_main_init();
-    protocol_main_init();
-
     // so matches pattern when standalone/mt
     serverActive=true;
     req_serverQuit=false;
@@ -31,6 +28,7 @@ int main(int argc, char** argv)
     int rv;
     rv=server_main(&args);
 
+    bvlog::stop();
     return rv;
 }
 
@@ -20,7 +20,9 @@
 #define BV_SETTINGS_HPP_INCLUDED
 
 #include <boost/lexical_cast.hpp>
+#include <limits>
 #include <map>
+#include <stdexcept>
 
 typedef std::map<string,string> property_map;
 
@@ -52,4 +54,32 @@ public:
     cfg_val &operator [](const cfg_key &id) {return cfg[id];}
 };
 
+/** @brief a setting that is not a number in its range (see v2num) */
+struct bad_setting : public std::runtime_error {
+    bad_setting(const string &msg) : std::runtime_error(msg) {}
+};
+
+/**
+*   @brief numeric setting key of cfg
+*
+*   Unlike a plain lexical_cast to an unsigned type a negative
+*   value is refused rather than wrapped around.
+*
+*   @throw bad_setting naming key if it is not a number from lo to hi
+*/
+template<typename T>
+T v2num(Configurator &cfg,const string &key,T lo=0,T hi=std::numeric_limits<T>::max()) {
+    const string &val=cfg[key];
+    s64 n=0;
+    bool ok=true;
+    try {
+        n=boost::lexical_cast<s64>(val);
+    } catch (boost::bad_lexical_cast &e) {
+        ok=false;
+    }
+    if (!ok || n<s64(lo) || (n>0 && u64(n)>u64(hi)))
+        throw bad_setting(key+"=\""+val+"\" is not a number from "+v2str(lo)+" to "+v2str(hi));
+    return T(n);
+}
+
 #endif // BV_SETTINGS_HPP_INCLUDED